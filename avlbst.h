@@ -1,12 +1,14 @@
-#ifndef RBBST_H
-#define RBBST_H
+#ifndef AVLBST_H
+#define AVLBST_H
 
 #include <iostream>
 #include <exception>
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <vector>
 #include "bst.h"
+#include "thread_pool.h"
 
 struct KeyError { };
 
@@ -21,19 +23,20 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    AVLNode(AVLNode<Key, Value>* parent, ItemBuilder<Key, Value>& item);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
-    // Getters for parent, left, and right. These need to be redefined since they
+    // Getters for parent, left, and right. These hide the Node versions since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
     // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
 
 protected:
     int8_t balance_;    // effectively a signed char
@@ -56,6 +59,16 @@ AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Va
 
 }
 
+/**
+* A constructor having item build the key/value pair, see ItemBuilder.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>::AVLNode(AVLNode<Key, Value>* parent, ItemBuilder<Key, Value>& item) :
+    Node<Key, Value>(parent, item), balance_(0)
+{
+
+}
+
 /**
 * A destructor which does nothing.
 */
@@ -93,8 +106,8 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
-* that our node is a AVLNode.
+* A getter for the parent which hides Node::getParent, since a static_cast is necessary to make sure
+* that our node is a AVLNode. The cast is resolved at compile time.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
@@ -103,7 +116,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
@@ -112,7 +125,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
@@ -128,31 +141,170 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+template <class Key, class Value, class Compare = std::less<Key> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare>
 {
 public:
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator iterator;
+
+    AVLTree();
+    explicit AVLTree(const Compare& comp);
+    template<typename InputIterator>
+    AVLTree(InputIterator first, InputIterator last, const Compare& comp = Compare());
+    template<typename InputIterator>
+    AVLTree(ParallelTag, InputIterator first, InputIterator last, const Compare& comp = Compare());
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    virtual void insert (std::pair<const Key, Value>&& new_item);
     virtual void remove(const Key& key);  // TODO
+    void clear();
+
+    // Bulk operations built on joining two trees around a middle node.
+    // Each takes every node of its argument, leaving it empty.
+    void join(AVLTree& greater);
+    void split(const Key& key, AVLTree& greater);
+    void unionWith(AVLTree& other);
+    void intersect(AVLTree& other);
+    void difference(AVLTree& other);
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
 
     // Add helper functions here
-    void insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n);
-    void rotateRight(AVLNode<Key,Value>* n);
-    void rotateLeft(AVLNode<Key,Value>* n);
-    void removeFix(AVLNode<Key,Value>* n, int diff);
+    virtual void linkNode(Node<Key, Value>* n, Node<Key, Value>* parent, bool goRight);
+    virtual Node<Key, Value>* makeNode(Node<Key, Value>* parent, ItemBuilder<Key, Value>& item);
+    // These only touch the nodes they are given, never root_, so they can
+    // work on detached subtrees (see joinNodes) on several threads at once.
+    void insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n) const;
+    using BinarySearchTree<Key, Value, Compare>::rotateRight;
+    using BinarySearchTree<Key, Value, Compare>::rotateLeft;
+    void removeFix(AVLNode<Key,Value>* n, int diff) const;
+    static AVLNode<Key,Value>* topOf(AVLNode<Key,Value>* n);
     AVLNode<Key,Value>* predecessor(AVLNode<Key, Value>* current);
-    virtual void clear();
+
+    // Helpers for the bulk operations. They work on detached subtrees (root
+    // parent null), return the root of the result and pass every subtree's
+    // height along with it, since AVLNode only records balances.
+    static int height(AVLNode<Key,Value>* n);
+    static int childHeight(AVLNode<Key,Value>* n, int h, bool right);
+    AVLNode<Key,Value>* joinNodes(AVLNode<Key,Value>* left, int leftHeight, AVLNode<Key,Value>* middle,
+                                  AVLNode<Key,Value>* right, int rightHeight, int& h) const;
+    AVLNode<Key,Value>* joinNodes(AVLNode<Key,Value>* left, int leftHeight,
+                                  AVLNode<Key,Value>* right, int rightHeight, int& h) const;
+    AVLNode<Key,Value>* splitLast(AVLNode<Key,Value>* n, int nHeight, AVLNode<Key,Value>*& last, int& h) const;
+    AVLNode<Key,Value>* splitNodes(AVLNode<Key,Value>* n, int nHeight, const Key& key,
+                                   AVLNode<Key,Value>*& less, int& lessHeight,
+                                   AVLNode<Key,Value>*& greater, int& greaterHeight) const;
+    typedef std::vector<AVLNode<Key,Value>*> Garbage;
+    AVLNode<Key,Value>* unionNodes(AVLNode<Key,Value>* a, int aHeight, AVLNode<Key,Value>* b, int bHeight,
+                                   Garbage& garbage, int& h) const;
+    AVLNode<Key,Value>* intersectNodes(AVLNode<Key,Value>* a, int aHeight, AVLNode<Key,Value>* b, int bHeight,
+                                       Garbage& garbage, int& h) const;
+    AVLNode<Key,Value>* differenceNodes(AVLNode<Key,Value>* a, int aHeight, AVLNode<Key,Value>* b, int bHeight,
+                                        Garbage& garbage, int& h) const;
+    template<typename Left, typename Right>
+    static void forkIfLarge(std::size_t work, Garbage& garbage, Left left, Right right);
+    static void collectNodes(AVLNode<Key,Value>* n, Garbage& garbage);
+    AVLNode<Key,Value>* takeNodes(AVLTree& other);
+    void setRoot(AVLNode<Key,Value>* root, Garbage& garbage);
+
+    virtual Node<Key,Value>* buildSubtree(
+        std::vector<std::pair<Key, Value> >& items, std::size_t lo, std::size_t hi,
+        Node<Key,Value>* parent, int& height, NodePool& pool, bool parallel);
+    virtual void loaded();
 
 protected:   
     AVLNode<Key,Value>* root_ = nullptr;
 
 };
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::clear(){
-    BinarySearchTree<Key,Value>::clear();
+/**
+* Default constructor, which sizes the node pool for AVLNodes.
+*/
+template<class Key, class Value, typename Compare>
+AVLTree<Key, Value, Compare>::AVLTree() :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(AVLNode<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<AVLNode<Key, Value> >,
+        Compare())
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by the given comparator.
+*/
+template<class Key, class Value, typename Compare>
+AVLTree<Key, Value, Compare>::AVLTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(AVLNode<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<AVLNode<Key, Value> >,
+        comp)
+{
+
+}
+
+/**
+* Range constructor which builds a balanced tree from the given items.
+*/
+template<class Key, class Value, typename Compare>
+template<typename InputIterator>
+AVLTree<Key, Value, Compare>::AVLTree(InputIterator first, InputIterator last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(AVLNode<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<AVLNode<Key, Value> >,
+        comp)
+{
+    this->bulkLoad(first, last);
+}
+
+/**
+* Range constructor which sorts and builds in parallel, see
+* BinarySearchTree::parallelBulkLoad.
+*/
+template<class Key, class Value, typename Compare>
+template<typename InputIterator>
+AVLTree<Key, Value, Compare>::AVLTree(ParallelTag, InputIterator first, InputIterator last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(AVLNode<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<AVLNode<Key, Value> >,
+        comp)
+{
+    this->parallelBulkLoad(first, last);
+}
+
+/**
+* Picks up the root of a tree built by bulkLoad or parallelBulkLoad, which
+* only set the base class's root_.
+*/
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::loaded()
+{
+    root_ = static_cast<AVLNode<Key,Value>*>(BinarySearchTree<Key, Value, Compare>::root_);
+}
+
+/**
+* Same as the base version but creates AVLNodes and records each node's
+* balance from the heights of the two halves.
+*/
+template<class Key, class Value, typename Compare>
+Node<Key,Value>* AVLTree<Key, Value, Compare>::buildSubtree(
+    std::vector<std::pair<Key, Value> >& items, std::size_t lo, std::size_t hi,
+    Node<Key,Value>* parent, int& height, NodePool& pool, bool parallel)
+{
+    if(lo >= hi)
+    {
+        height = 0;
+        return nullptr;
+    }
+    std::size_t mid = lo + (hi - lo) / 2;
+    AVLNode<Key,Value>* n = this->template createNodeIn<AVLNode<Key,Value> >(
+        pool, items[mid].first, items[mid].second, static_cast<AVLNode<Key,Value>*>(parent));
+    int leftHeight, rightHeight;
+    this->buildChildren(items, lo, mid, hi, n, leftHeight, rightHeight, pool, parallel);
+    n -> setBalance(rightHeight - leftHeight);
+    n -> setSize(hi - lo);
+    height = std::max(leftHeight, rightHeight) + 1;
+    return n;
+}
+
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::clear(){
+    BinarySearchTree<Key, Value, Compare>::clear();
     root_ = nullptr;
 }
 
@@ -160,71 +312,75 @@ void AVLTree<Key, Value>::clear(){
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::insert (const std::pair<const Key, Value> &new_item)
 {
     // TODO
-    AVLNode<Key,Value>* temp = new AVLNode<Key,Value>(new_item.first, new_item.second, nullptr);
-    temp -> setBalance(0);
+    this->insert_or_assign(new_item.first, new_item.second);
+}
+
+/**
+* Same as above, but moves the value out of new_item instead of copying it.
+*/
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::insert (std::pair<const Key, Value>&& new_item)
+{
+    this->insert_or_assign(new_item.first, std::move(new_item.second));
+}
+
+/**
+* Makes every new node an AVLNode, whichever insert made it.
+*/
+template<class Key, class Value, typename Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::makeNode(Node<Key, Value>* parent, ItemBuilder<Key, Value>& item)
+{
+    return this->template createNode<AVLNode<Key, Value> >(static_cast<AVLNode<Key, Value>*>(parent), item);
+}
+
+/**
+* Links a new leaf in below p and walks back up fixing the balances.
+*/
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::linkNode(Node<Key, Value>* n, Node<Key, Value>* parent, bool goRight)
+{
+    AVLNode<Key,Value>* temp = static_cast<AVLNode<Key,Value>*>(n);
+    AVLNode<Key,Value>* p = static_cast<AVLNode<Key,Value>*>(parent);
     //if tree empty
-    if(root_ == nullptr){
+    if(p == nullptr)
+    {
         root_ = temp;
     }
     else
     {
-        //find leaf node
-        AVLNode<Key,Value>* current = root_;
-        AVLNode<Key,Value>* p = current;
-        while(current != nullptr)
-        {
-            p = current;
-            if(current -> getKey() == new_item.first)
-            {
-                current -> setValue(new_item.second);
-                break;
-            }
-            //go right
-            else if(new_item.first > current -> getKey())
-            {
-                current = current -> getRight();
-            }
-            //go left
-            else
-            {
-                current = current -> getLeft();
-            }
-        }
-
-        if(current != nullptr) {
-            delete temp;
-            return;
-        }
         //set right
-        if(new_item.first > p -> getKey())
+        if(goRight)
         {
-            temp -> setParent(p);
             p -> setRight(temp);
             p -> updateBalance(1);
         }
         //set left
-        else if(new_item.first < p -> getKey())
+        else
         {
-            temp -> setParent(p);
             p -> setLeft(temp);
             p -> updateBalance(-1);
         }
 
+        //sizes first, the rotations in insertFix recompute their own nodes
+        this->updatePathSizes(p, 1);
         if(p -> getBalance() != 0)
         {
             insertFix(p, temp);
         }
+        //a rotation at the top moves the root down
+        root_ = topOf(root_);
     }
-    BinarySearchTree<Key,Value>::root_ = root_;
+    BinarySearchTree<Key, Value, Compare>::root_ = root_;
 }
 
-template<class Key, class Value>
-void AVLTree<Key,Value>::insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n)
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n) const
 {
+    TREE_STAT(TreeCounters::add(this->counters_.insertFixSteps));
     if(p == nullptr) return;
     else if(p -> getParent() == nullptr)
     {
@@ -234,7 +390,7 @@ void AVLTree<Key,Value>::insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n)
     AVLNode<Key,Value>* g = p -> getParent();
 
     //if p is the left child
-    if(p -> getKey() < g -> getKey())
+    if(p == g -> getLeft())
     {
         int gBalance = g -> getBalance();
         //balance = 1
@@ -348,92 +504,26 @@ void AVLTree<Key,Value>::insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n)
     
 }
 
-template<typename Key, typename Value>
-void AVLTree<Key,Value>::rotateRight(AVLNode<Key,Value>* n)
+/**
+* Returns the root of the tree n is in.
+*/
+template<typename Key, typename Value, typename Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::topOf(AVLNode<Key,Value>* n)
 {
-    AVLNode<Key,Value>* tempLeft = n -> getLeft();
-    //make left's parent the current parent
-    tempLeft -> setParent(n -> getParent());
-    if(n -> getParent() != nullptr)
-    {
-        
-        //make the child of the parent the left node
-        if (n -> getKey() > n -> getParent() -> getKey())
-        {
-            //true if right child
-            tempLeft -> getParent() -> setRight(tempLeft);
-        }
-        else
-        {
-            //true if left child
-            tempLeft -> getParent() -> setLeft(tempLeft);
-        }
-    }
-    
-    //make the left of current the right of the left
-    n -> setLeft(tempLeft -> getRight());
-    //make the parent of the moved node n
-    if(n -> getLeft() != nullptr) n -> getLeft() -> setParent(n);
-    //make the right the current
-    tempLeft -> setRight(n);
-    //set the parent to the left
-    n -> setParent(tempLeft);
-    if(tempLeft -> getParent() == nullptr) root_ = tempLeft;
-}
-
-template<typename Key, typename Value>
-void AVLTree<Key,Value>::rotateLeft(AVLNode<Key,Value>* n)
-{
-    AVLNode<Key,Value>* tempRight = n -> getRight();
-    //make right parent the current parent
-    tempRight -> setParent(n -> getParent());
-    if(n -> getParent() != nullptr)
-    {
-        
-        //make the child of the parent the right node
-        if (n -> getKey() > n -> getParent() -> getKey())
-        {
-            //true if right child
-            tempRight -> getParent() -> setRight(tempRight);
-        }
-        else
-        {
-            //true if left child
-            tempRight -> getParent() -> setLeft(tempRight);
-        }
-    }
-    
-    //make the right of current the left of the right
-    n -> setRight(tempRight -> getLeft());
-    //make the parent of the moved node n
-    if(n -> getRight() != nullptr) n -> getRight() -> setParent(n);
-    //make left the current
-    tempRight -> setLeft(n);
-    //set the parent to the left
-    n -> setParent(tempRight);
-    if(tempRight -> getParent() == nullptr) root_ = tempRight;
+    while(n -> getParent() != nullptr) n = n -> getParent();
+    return n;
 }
 
 /*
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::remove(const Key& key)
 {
     if(root_ == nullptr) return;
     // TODO
-    AVLNode<Key,Value>* current = root_;
-    while(current != nullptr)
-    {
-        if(current -> getKey() == key)
-        {
-            break;
-        }
-
-        if(key > current -> getKey()) current = current -> getRight();
-        else current = current -> getLeft();
-    }
+    AVLNode<Key,Value>* current = static_cast<AVLNode<Key,Value>*>(this->internalFind(key));
 
     if(current == nullptr) return;
 
@@ -446,7 +536,7 @@ void AVLTree<Key, Value>::remove(const Key& key)
 
     AVLNode<Key,Value>* p = current -> getParent();
 
-    int diff;
+    int diff = 0;
     //setting diff value for fix
     if(p != nullptr)
     {
@@ -500,15 +590,18 @@ void AVLTree<Key, Value>::remove(const Key& key)
             root_ = nullptr;
         }
     }
-    delete current;
+    this->destroyNode(current);
 
+    this->updatePathSizes(p, -1);
     removeFix(p,diff);
-    BinarySearchTree<Key,Value>::root_ = root_;
+    if(root_ != nullptr) root_ = topOf(root_);
+    BinarySearchTree<Key, Value, Compare>::root_ = root_;
 }
 
-template<typename Key, typename Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key,Value>* n, int diff)
+template<typename Key, typename Value, typename Compare>
+void AVLTree<Key, Value, Compare>::removeFix(AVLNode<Key,Value>* n, int diff) const
 {
+    TREE_STAT(TreeCounters::add(this->counters_.removeFixSteps));
     if(n == nullptr) return;
 
     AVLNode<Key,Value>* p = n -> getParent();
@@ -516,7 +609,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key,Value>* n, int diff)
     if(p != nullptr)
     {
         //left child
-        if(n -> getKey() < p -> getKey()) ndiff = 1;
+        if(n == p -> getLeft()) ndiff = 1;
         //right child
         else ndiff = -1;
     }
@@ -652,51 +745,502 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key,Value>* n, int diff)
 
 }
 
-template<class Key, class Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::predecessor(AVLNode<Key, Value>* current)
+template<class Key, class Value, typename Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::predecessor(AVLNode<Key, Value>* current)
 {
     // TODO
-    // has a left child then go to 
-    if(current -> getLeft() != nullptr)
+    return static_cast<AVLNode<Key,Value>*>(BinarySearchTree<Key, Value, Compare>::predecessor(current));
+}
+
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::nodeSwap(AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+{
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
+    int8_t tempB = n1->getBalance();
+    n1->setBalance(n2->getBalance());
+    n2->setBalance(tempB);
+}
+
+
+/**
+* Returns the height of n's subtree in O(height) by always stepping into
+* the taller child.
+*/
+template<class Key, class Value, typename Compare>
+int AVLTree<Key, Value, Compare>::height(AVLNode<Key,Value>* n)
+{
+    int h = 0;
+    while(n != nullptr)
     {
-        //go to the left child
-        AVLNode<Key,Value>* temp = current -> getLeft();
-        //find right most child
-        while(temp -> getRight() != nullptr)
-        {
-            temp = temp -> getRight();
-        }
-        return temp;
+        ++h;
+        n = (n -> getBalance() > 0) ? n -> getRight() : n -> getLeft();
     }
-    // has a parent
-    else if(current -> getParent() != nullptr)
+    return h;
+}
+
+/**
+* The height of n's left or right subtree, given that n's is h.
+*/
+template<class Key, class Value, typename Compare>
+int AVLTree<Key, Value, Compare>::childHeight(AVLNode<Key,Value>* n, int h, bool right)
+{
+    int balance = n -> getBalance();
+    if(right) return (balance >= 0) ? h - 1 : h - 2;
+    return (balance <= 0) ? h - 1 : h - 2;
+}
+
+/**
+* Joins left, middle and right, where every key in left is below middle's
+* and every key in right above it, into one balanced tree in
+* O(|leftHeight - rightHeight|). When the heights are close middle simply
+* becomes the root. Otherwise middle is hung off the side of the taller
+* tree at the first node no more than one level taller than the shorter
+* tree; that subtree grew by exactly one level, as after an insert, so
+* insertFix finishes the job.
+*/
+template<class Key, class Value, typename Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::joinNodes(AVLNode<Key,Value>* left, int leftHeight,
+    AVLNode<Key,Value>* middle, AVLNode<Key,Value>* right, int rightHeight, int& h) const
+{
+    middle -> setParent(nullptr);
+    if(leftHeight <= rightHeight + 1 && rightHeight <= leftHeight + 1)
     {
-        //right child
-        if(current -> getKey() <= current -> getParent() -> getKey())
-        {
-            return (current -> getParent());
-        }
-        //left child
-        else
-        { 
-            return (current -> getParent() -> getParent());
-        }
+        middle -> setLeft(left);
+        middle -> setRight(right);
+        if(left != nullptr) left -> setParent(middle);
+        if(right != nullptr) right -> setParent(middle);
+        middle -> setBalance(rightHeight - leftHeight);
+        BinarySearchTree<Key, Value, Compare>::updateSize(middle);
+        h = std::max(leftHeight, rightHeight) + 1;
+        return middle;
+    }
+
+    bool goRight = leftHeight > rightHeight;
+    AVLNode<Key,Value>* top = goRight ? left : right;
+    AVLNode<Key,Value>* shorter = goRight ? right : left;
+    int topHeight = goRight ? leftHeight : rightHeight;
+    int shorterHeight = goRight ? rightHeight : leftHeight;
+
+    //walk down the inner edge of the taller tree
+    AVLNode<Key,Value>* p = nullptr;
+    AVLNode<Key,Value>* c = top;
+    int cHeight = topHeight;
+    while(cHeight > shorterHeight + 1)
+    {
+        p = c;
+        cHeight = childHeight(c, cHeight, goRight);
+        c = goRight ? c -> getRight() : c -> getLeft();
+    }
+
+    if(goRight)
+    {
+        middle -> setLeft(c);
+        middle -> setRight(shorter);
+        middle -> setBalance(shorterHeight - cHeight);
+        p -> setRight(middle);
     }
-    //has no parent means it is the root node with no left child
     else
     {
-        //means it is "right most" node in tree
+        middle -> setLeft(shorter);
+        middle -> setRight(c);
+        middle -> setBalance(cHeight - shorterHeight);
+        p -> setLeft(middle);
+    }
+    if(c != nullptr) c -> setParent(middle);
+    if(shorter != nullptr) shorter -> setParent(middle);
+    middle -> setParent(p);
+    BinarySearchTree<Key, Value, Compare>::updateSize(middle);
+
+    std::size_t added = 1 + BinarySearchTree<Key, Value, Compare>::subtreeSize(shorter);
+    for(AVLNode<Key,Value>* a = p; a != nullptr; a = a -> getParent())
+    {
+        a -> setSize(a -> getSize() + added);
+    }
+    //c is the inner grandchild insertFix's double rotation looks at
+    int topBalance = top -> getBalance();
+    insertFix(middle, c);
+
+    //as after an insert, the tree only grew if no rotation stopped the
+    //growth on its way up, leaving a balanced top leaning
+    AVLNode<Key,Value>* result = topOf(p);
+    h = topHeight;
+    if(result == top && topBalance == 0 && top -> getBalance() != 0) ++h;
+    return result;
+}
+
+/**
+* Joins left and right, where every key in left is below every key in
+* right, by taking left's largest node as the middle.
+*/
+template<class Key, class Value, typename Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::joinNodes(AVLNode<Key,Value>* left, int leftHeight,
+    AVLNode<Key,Value>* right, int rightHeight, int& h) const
+{
+    if(left == nullptr)
+    {
+        h = rightHeight;
+        return right;
+    }
+    if(right == nullptr)
+    {
+        h = leftHeight;
+        return left;
+    }
+    AVLNode<Key,Value>* last;
+    int restHeight;
+    AVLNode<Key,Value>* rest = splitLast(left, leftHeight, last, restHeight);
+    return joinNodes(rest, restHeight, last, right, rightHeight, h);
+}
+
+/**
+* Detaches the largest node of n's subtree into last and returns the rest.
+*/
+template<class Key, class Value, typename Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::splitLast(
+    AVLNode<Key,Value>* n, int nHeight, AVLNode<Key,Value>*& last, int& h) const
+{
+    AVLNode<Key,Value>* left = n -> getLeft();
+    AVLNode<Key,Value>* right = n -> getRight();
+    int leftHeight = childHeight(n, nHeight, false);
+    if(left != nullptr) left -> setParent(nullptr);
+    if(right == nullptr)
+    {
+        last = n;
+        h = leftHeight;
+        return left;
+    }
+    right -> setParent(nullptr);
+    int restHeight;
+    AVLNode<Key,Value>* rest = splitLast(right, childHeight(n, nHeight, true), last, restHeight);
+    return joinNodes(left, leftHeight, n, rest, restHeight, h);
+}
+
+/**
+* Splits n's subtree into the keys below key (less) and above it (greater),
+* rejoining the nodes on the search path to whichever side they belong.
+* Returns the node holding key, detached, or null. O(height).
+*/
+template<class Key, class Value, typename Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::splitNodes(AVLNode<Key,Value>* n, int nHeight, const Key& key,
+    AVLNode<Key,Value>*& less, int& lessHeight, AVLNode<Key,Value>*& greater, int& greaterHeight) const
+{
+    if(n == nullptr)
+    {
+        less = nullptr;
+        greater = nullptr;
+        lessHeight = 0;
+        greaterHeight = 0;
         return nullptr;
     }
+    AVLNode<Key,Value>* left = n -> getLeft();
+    AVLNode<Key,Value>* right = n -> getRight();
+    int leftHeight = childHeight(n, nHeight, false);
+    int rightHeight = childHeight(n, nHeight, true);
+    if(left != nullptr) left -> setParent(nullptr);
+    if(right != nullptr) right -> setParent(nullptr);
+
+    if(this->comp_(key, n -> getKey()))
+    {
+        AVLNode<Key,Value>* between;
+        int betweenHeight;
+        AVLNode<Key,Value>* found = splitNodes(left, leftHeight, key, less, lessHeight, between, betweenHeight);
+        greater = joinNodes(between, betweenHeight, n, right, rightHeight, greaterHeight);
+        return found;
+    }
+    if(this->comp_(n -> getKey(), key))
+    {
+        AVLNode<Key,Value>* between;
+        int betweenHeight;
+        AVLNode<Key,Value>* found = splitNodes(right, rightHeight, key, between, betweenHeight, greater, greaterHeight);
+        less = joinNodes(left, leftHeight, n, between, betweenHeight, lessHeight);
+        return found;
+    }
+    less = left;
+    lessHeight = leftHeight;
+    greater = right;
+    greaterHeight = rightHeight;
+    n -> setLeft(nullptr);
+    n -> setRight(nullptr);
+    return n;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap(AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+/**
+* Runs left and right in parallel on the shared ThreadPool when there are
+* at least PARALLEL_GRAIN nodes of work, each with its own garbage list.
+*/
+template<class Key, class Value, typename Compare>
+template<typename Left, typename Right>
+void AVLTree<Key, Value, Compare>::forkIfLarge(std::size_t work, Garbage& garbage, Left left, Right right)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
-    int8_t tempB = n1->getBalance();
-    n1->setBalance(n2->getBalance());
-    n2->setBalance(tempB);
+    if(work < BinarySearchTree<Key, Value, Compare>::PARALLEL_GRAIN || ThreadPool::shared().workers() == 0)
+    {
+        left(garbage);
+        right(garbage);
+        return;
+    }
+    Garbage rightGarbage;
+    ThreadPool::shared().forkJoin([&]() { left(garbage); }, [&]() { right(rightGarbage); });
+    garbage.insert(garbage.end(), rightGarbage.begin(), rightGarbage.end());
+}
+
+/**
+* Union of two detached subtrees: split b around a's root, union the halves
+* (in parallel when large) and join them back around a's root. A key in
+* both keeps b's value; b's node for it goes to garbage.
+* O(m log(n/m + 1)) work for subtrees of sizes m <= n.
+*/
+template<class Key, class Value, typename Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::unionNodes(AVLNode<Key,Value>* a, int aHeight,
+    AVLNode<Key,Value>* b, int bHeight, Garbage& garbage, int& h) const
+{
+    if(a == nullptr)
+    {
+        h = bHeight;
+        return b;
+    }
+    if(b == nullptr)
+    {
+        h = aHeight;
+        return a;
+    }
+    std::size_t work = a -> getSize() + b -> getSize();
+    AVLNode<Key,Value>* aLeft = a -> getLeft();
+    AVLNode<Key,Value>* aRight = a -> getRight();
+    int aLeftHeight = childHeight(a, aHeight, false);
+    int aRightHeight = childHeight(a, aHeight, true);
+    if(aLeft != nullptr) aLeft -> setParent(nullptr);
+    if(aRight != nullptr) aRight -> setParent(nullptr);
+
+    AVLNode<Key,Value>* bLeft;
+    AVLNode<Key,Value>* bRight;
+    int bLeftHeight, bRightHeight;
+    AVLNode<Key,Value>* same = splitNodes(b, bHeight, a -> getKey(), bLeft, bLeftHeight, bRight, bRightHeight);
+    if(same != nullptr)
+    {
+        a -> setValue(std::move(same -> getValue()));
+        garbage.push_back(same);
+    }
+
+    AVLNode<Key,Value>* left;
+    AVLNode<Key,Value>* right;
+    int leftHeight, rightHeight;
+    forkIfLarge(work, garbage,
+        [&](Garbage& g) { left = unionNodes(aLeft, aLeftHeight, bLeft, bLeftHeight, g, leftHeight); },
+        [&](Garbage& g) { right = unionNodes(aRight, aRightHeight, bRight, bRightHeight, g, rightHeight); });
+    return joinNodes(left, leftHeight, a, right, rightHeight, h);
+}
+
+/**
+* Intersection of two detached subtrees, keeping a's values. Every node of
+* b, and every node of a whose key b lacks, goes to garbage.
+*/
+template<class Key, class Value, typename Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::intersectNodes(AVLNode<Key,Value>* a, int aHeight,
+    AVLNode<Key,Value>* b, int bHeight, Garbage& garbage, int& h) const
+{
+    if(a == nullptr || b == nullptr)
+    {
+        collectNodes(a, garbage);
+        collectNodes(b, garbage);
+        h = 0;
+        return nullptr;
+    }
+    std::size_t work = a -> getSize() + b -> getSize();
+    AVLNode<Key,Value>* aLeft = a -> getLeft();
+    AVLNode<Key,Value>* aRight = a -> getRight();
+    int aLeftHeight = childHeight(a, aHeight, false);
+    int aRightHeight = childHeight(a, aHeight, true);
+    if(aLeft != nullptr) aLeft -> setParent(nullptr);
+    if(aRight != nullptr) aRight -> setParent(nullptr);
+
+    AVLNode<Key,Value>* bLeft;
+    AVLNode<Key,Value>* bRight;
+    int bLeftHeight, bRightHeight;
+    AVLNode<Key,Value>* same = splitNodes(b, bHeight, a -> getKey(), bLeft, bLeftHeight, bRight, bRightHeight);
+
+    AVLNode<Key,Value>* left;
+    AVLNode<Key,Value>* right;
+    int leftHeight, rightHeight;
+    forkIfLarge(work, garbage,
+        [&](Garbage& g) { left = intersectNodes(aLeft, aLeftHeight, bLeft, bLeftHeight, g, leftHeight); },
+        [&](Garbage& g) { right = intersectNodes(aRight, aRightHeight, bRight, bRightHeight, g, rightHeight); });
+
+    if(same != nullptr)
+    {
+        garbage.push_back(same);
+        return joinNodes(left, leftHeight, a, right, rightHeight, h);
+    }
+    garbage.push_back(a);
+    return joinNodes(left, leftHeight, right, rightHeight, h);
+}
+
+/**
+* a without the keys in b: split a around b's root and drop it from both
+* halves. Every node of b, and every node of a whose key b has, goes to
+* garbage.
+*/
+template<class Key, class Value, typename Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::differenceNodes(AVLNode<Key,Value>* a, int aHeight,
+    AVLNode<Key,Value>* b, int bHeight, Garbage& garbage, int& h) const
+{
+    if(a == nullptr || b == nullptr)
+    {
+        collectNodes(b, garbage);
+        h = aHeight;
+        return a;
+    }
+    std::size_t work = a -> getSize() + b -> getSize();
+    AVLNode<Key,Value>* bLeft = b -> getLeft();
+    AVLNode<Key,Value>* bRight = b -> getRight();
+    int bLeftHeight = childHeight(b, bHeight, false);
+    int bRightHeight = childHeight(b, bHeight, true);
+    if(bLeft != nullptr) bLeft -> setParent(nullptr);
+    if(bRight != nullptr) bRight -> setParent(nullptr);
+
+    AVLNode<Key,Value>* aLeft;
+    AVLNode<Key,Value>* aRight;
+    int aLeftHeight, aRightHeight;
+    AVLNode<Key,Value>* same = splitNodes(a, aHeight, b -> getKey(), aLeft, aLeftHeight, aRight, aRightHeight);
+    if(same != nullptr) garbage.push_back(same);
+    garbage.push_back(b);
+
+    AVLNode<Key,Value>* left;
+    AVLNode<Key,Value>* right;
+    int leftHeight, rightHeight;
+    forkIfLarge(work, garbage,
+        [&](Garbage& g) { left = differenceNodes(aLeft, aLeftHeight, bLeft, bLeftHeight, g, leftHeight); },
+        [&](Garbage& g) { right = differenceNodes(aRight, aRightHeight, bRight, bRightHeight, g, rightHeight); });
+    return joinNodes(left, leftHeight, right, rightHeight, h);
+}
+
+/**
+* Appends every node of n's subtree to garbage, using garbage itself as
+* the work list.
+*/
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::collectNodes(AVLNode<Key,Value>* n, Garbage& garbage)
+{
+    if(n == nullptr) return;
+    std::size_t next = garbage.size();
+    garbage.push_back(n);
+    for(; next < garbage.size(); ++next)
+    {
+        if(garbage[next] -> getLeft() != nullptr) garbage.push_back(garbage[next] -> getLeft());
+        if(garbage[next] -> getRight() != nullptr) garbage.push_back(garbage[next] -> getRight());
+    }
+}
+
+/**
+* Moves other's nodes, and the pool memory they live in, into this tree,
+* returning their root. other is left empty.
+*/
+template<class Key, class Value, typename Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::takeNodes(AVLTree& other)
+{
+    AVLNode<Key,Value>* nodes = other.root_;
+    this->pool_.adopt(other.pool_);
+    other.root_ = nullptr;
+    other.BinarySearchTree<Key, Value, Compare>::root_ = nullptr;
+    return nodes;
+}
+
+/**
+* Installs root as the tree and destroys the nodes the operation dropped.
+*/
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::setRoot(AVLNode<Key,Value>* root, Garbage& garbage)
+{
+    root_ = root;
+    BinarySearchTree<Key, Value, Compare>::root_ = root_;
+    for(std::size_t i = 0; i < garbage.size(); ++i)
+    {
+        this->destroyNode(garbage[i]);
+    }
+}
+
+/**
+* Appends greater, whose keys must all be above this tree's, in
+* O(log n). greater is left empty.
+*/
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::join(AVLTree& greater)
+{
+    if(&greater == this) return;
+    Garbage none;
+    AVLNode<Key,Value>* right = takeNodes(greater);
+    int h;
+    setRoot(joinNodes(root_, height(root_), right, height(right), h), none);
+}
+
+/**
+* Moves every item with a key not below key into greater, replacing what
+* greater held, in O(log n). The two trees then share this tree's pool
+* memory, which stays alive until both are done with it.
+*/
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::split(const Key& key, AVLTree& greater)
+{
+    if(&greater == this) return;
+    greater.clear();
+    greater.pool_.share(this->pool_);
+
+    AVLNode<Key,Value>* less;
+    AVLNode<Key,Value>* more;
+    int lessHeight, moreHeight;
+    AVLNode<Key,Value>* same = splitNodes(root_, height(root_), key, less, lessHeight, more, moreHeight);
+    if(same != nullptr) more = joinNodes(nullptr, 0, same, more, moreHeight, moreHeight);
+
+    Garbage none;
+    setRoot(less, none);
+    greater.setRoot(more, none);
+}
+
+/**
+* Adds every item of other, overwriting the values of keys already here,
+* like inserting them one by one but in O(m log(n/m + 1)) work for sizes
+* m <= n, with independent subtrees handled in parallel. other is left
+* empty.
+*/
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::unionWith(AVLTree& other)
+{
+    if(&other == this) return;
+    Garbage garbage;
+    AVLNode<Key,Value>* b = takeNodes(other);
+    int h;
+    setRoot(unionNodes(root_, height(root_), b, height(b), garbage, h), garbage);
+}
+
+/**
+* Keeps only the items whose keys are also in other, in the same time as
+* unionWith. other is left empty.
+*/
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::intersect(AVLTree& other)
+{
+    if(&other == this) return;
+    Garbage garbage;
+    AVLNode<Key,Value>* b = takeNodes(other);
+    int h;
+    setRoot(intersectNodes(root_, height(root_), b, height(b), garbage, h), garbage);
+}
+
+/**
+* Removes every item whose key is in other, in the same time as unionWith.
+* other is left empty.
+*/
+template<class Key, class Value, typename Compare>
+void AVLTree<Key, Value, Compare>::difference(AVLTree& other)
+{
+    if(&other == this)
+    {
+        clear();
+        return;
+    }
+    Garbage garbage;
+    AVLNode<Key,Value>* b = takeNodes(other);
+    int h;
+    setRoot(differenceNodes(root_, height(root_), b, height(b), garbage, h), garbage);
 }
 
 
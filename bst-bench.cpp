@@ -0,0 +1,771 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "btree.h"
+#include "concurrent_avl.h"
+#include "persistent_avl.h"
+#include "stack_avl.h"
+#include "compact_avl.h"
+#include "splay_tree.h"
+#include "scapegoat_tree.h"
+#include "flat_sorted_map.h"
+
+using namespace std;
+
+// Benchmark suite for the search trees. Every line written to stdout is
+// CSV so runs can be diffed or loaded into a spreadsheet:
+//   structure,distribution,operation,n,total_ms,ns_per_op
+// Usage: bst-bench [--quick] [n]
+
+// Keeps results alive so the optimizer cannot drop the timed loops.
+static long long checksum = 0;
+
+// Returns the number of milliseconds spent running fn.
+template<typename Function>
+double timeMs(Function fn)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    fn();
+    chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(stop - start).count();
+}
+
+void report(const char* structure, const char* distribution, const char* operation, size_t n, double ms)
+{
+    cout << structure << ',' << distribution << ',' << operation << ',' << n << ',' << ms << ','
+         << (n == 0 ? 0.0 : ms * 1e6 / n) << endl;
+}
+
+// Scatters a rank over the int range so hot Zipfian keys are not also
+// neighbours in key order.
+int scatter(uint32_t rank)
+{
+    return static_cast<int>(rank * 2654435761u);
+}
+
+// n distinct keys in random order.
+vector<int> randomKeys(size_t n, mt19937& rng)
+{
+    vector<int> keys(n);
+    for(size_t i = 0; i < n; ++i) {
+        keys[i] = scatter(static_cast<uint32_t>(i));
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+// n distinct keys in increasing order.
+vector<int> sortedKeys(size_t n)
+{
+    vector<int> keys(n);
+    for(size_t i = 0; i < n; ++i) {
+        keys[i] = static_cast<int>(i);
+    }
+    return keys;
+}
+
+// n distinct keys in increasing order except that each is swapped with
+// one up to 16 places further on, as from a stream that is only sorted
+// roughly.
+vector<int> nearlySortedKeys(size_t n, mt19937& rng)
+{
+    vector<int> keys = sortedKeys(n);
+    uniform_int_distribution<size_t> offset(0, 16);
+    for(size_t i = 0; i < n; ++i) {
+        swap(keys[i], keys[min(n - 1, i + offset(rng))]);
+    }
+    return keys;
+}
+
+// n draws from a Zipf(1.0) distribution over n ranks, so a few keys
+// account for most of the operations and many repeat.
+vector<int> zipfKeys(size_t n, mt19937& rng)
+{
+    vector<double> cdf(n);
+    double total = 0;
+    for(size_t i = 0; i < n; ++i) {
+        total += 1.0 / static_cast<double>(i + 1);
+        cdf[i] = total;
+    }
+    uniform_real_distribution<double> uniform(0, total);
+    vector<int> keys(n);
+    for(size_t i = 0; i < n; ++i) {
+        size_t rank = lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+        keys[i] = scatter(static_cast<uint32_t>(min(rank, n - 1)));
+    }
+    return keys;
+}
+
+// A SplayTree that only semi-splays, default constructible for benchOne.
+class SemiSplayTree : public SplayTree<int, int>
+{
+public:
+    SemiSplayTree() : SplayTree<int, int>(SEMI_SPLAY) {}
+};
+
+// Adapters giving std::map the same vocabulary as the trees.
+template<typename Tree>
+void put(Tree& tree, int key, int value)
+{
+    tree.insert(make_pair(key, value));
+}
+void put(map<int, int>& tree, int key, int value)
+{
+    tree[key] = value;
+}
+
+template<typename Tree>
+void erase(Tree& tree, int key)
+{
+    tree.remove(key);
+}
+void erase(map<int, int>& tree, int key)
+{
+    tree.erase(key);
+}
+
+template<typename Tree>
+void load(Tree& tree, const vector<pair<int, int> >& items)
+{
+    tree.bulkLoad(items.begin(), items.end());
+}
+void load(map<int, int>& tree, const vector<pair<int, int> >& items)
+{
+    map<int, int> sorted(items.begin(), items.end());
+    tree.swap(sorted);
+}
+
+// Runs every operation for one structure and key distribution, reporting
+// the fastest of reps runs of each.
+template<typename Tree>
+void benchOne(const char* structure, const char* distribution, const vector<int>& keys, int reps)
+{
+    const size_t n = keys.size();
+    double best[5] = {1e300, 1e300, 1e300, 1e300, 1e300};
+
+    vector<pair<int, int> > items;
+    items.reserve(n);
+    for(size_t i = 0; i < n; ++i) {
+        items.push_back(make_pair(keys[i], static_cast<int>(i)));
+    }
+
+    for(int rep = 0; rep < reps; ++rep) {
+        Tree tree;
+        best[0] = min(best[0], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                put(tree, keys[i], static_cast<int>(i));
+            }
+        }));
+        best[1] = min(best[1], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                checksum += tree.find(keys[i])->second;
+            }
+        }));
+        best[2] = min(best[2], timeMs([&]() {
+            for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+                checksum += it->second;
+            }
+        }));
+        best[3] = min(best[3], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                erase(tree, keys[i]);
+            }
+        }));
+        best[4] = min(best[4], timeMs([&]() {
+            load(tree, items);
+        }));
+    }
+
+    const char* names[5] = {"insert", "find", "iterate", "remove", "bulkload"};
+    for(int op = 0; op < 5; ++op) {
+        report(structure, distribution, names[op], n, best[op]);
+    }
+}
+
+// Times lookups and a full scan on an AVLTree frozen into a FrozenMap,
+// which only supports reads; "freeze" is the cost of the export itself.
+void benchFrozen(const char* distribution, const vector<int>& keys, int reps)
+{
+    const size_t n = keys.size();
+    double best[3] = {1e300, 1e300, 1e300};
+
+    AVLTree<int, int> tree;
+    for(size_t i = 0; i < n; ++i) {
+        put(tree, keys[i], static_cast<int>(i));
+    }
+    for(int rep = 0; rep < reps; ++rep) {
+        FrozenMap<int, int> frozen;
+        best[0] = min(best[0], timeMs([&]() {
+            frozen = tree.freeze();
+        }));
+        best[1] = min(best[1], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                checksum += frozen.find(keys[i])->second;
+            }
+        }));
+        best[2] = min(best[2], timeMs([&]() {
+            for(FrozenMap<int, int>::iterator it = frozen.begin(); it != frozen.end(); ++it) {
+                checksum += it->second;
+            }
+        }));
+    }
+
+    const char* names[3] = {"freeze", "find", "iterate"};
+    for(int op = 0; op < 3; ++op) {
+        report("FrozenMap", distribution, names[op], n, best[op]);
+    }
+}
+
+// Times looking keys up in batches of 256, as a loop over find and with
+// findBatch, which keeps several searches (and cache misses) in flight.
+template<typename Tree>
+void benchBatch(const char* structure, const char* distribution, const vector<int>& keys, int reps)
+{
+    const size_t n = keys.size();
+    const size_t batchSize = 256;
+    double best[2] = {1e300, 1e300};
+
+    Tree tree;
+    for(size_t i = 0; i < n; ++i) {
+        put(tree, keys[i], static_cast<int>(i));
+    }
+    vector<vector<int> > batches;
+    for(size_t i = 0; i < n; i += batchSize) {
+        batches.push_back(vector<int>(keys.begin() + i, keys.begin() + min(n, i + batchSize)));
+    }
+    vector<typename Tree::iterator> out;
+    for(int rep = 0; rep < reps; ++rep) {
+        best[0] = min(best[0], timeMs([&]() {
+            for(size_t b = 0; b < batches.size(); ++b) {
+                for(size_t i = 0; i < batches[b].size(); ++i) {
+                    checksum += tree.find(batches[b][i])->second;
+                }
+            }
+        }));
+        best[1] = min(best[1], timeMs([&]() {
+            for(size_t b = 0; b < batches.size(); ++b) {
+                tree.findBatch(batches[b], out);
+                for(size_t i = 0; i < out.size(); ++i) {
+                    checksum += out[i]->second;
+                }
+            }
+        }));
+    }
+
+    report(structure, distribution, "find-loop", n, best[0]);
+    report(structure, distribution, "find-batch", n, best[1]);
+}
+
+// Same ordering as std::less, but hides it from FlatSortedMap so lookups
+// take the plain std::lower_bound path, for comparison with the kernels.
+struct ScalarLess
+{
+    bool operator()(int a, int b) const { return a < b; }
+};
+
+// Times a bulk load, lookups and a full scan of a FlatSortedMap; inserting
+// the keys one at a time would take quadratic time.
+template<typename Map>
+void benchFlat(const char* structure, const char* distribution, const vector<int>& keys, int reps)
+{
+    const size_t n = keys.size();
+    double best[3] = {1e300, 1e300, 1e300};
+
+    vector<pair<int, int> > items;
+    items.reserve(n);
+    for(size_t i = 0; i < n; ++i) {
+        items.push_back(make_pair(keys[i], static_cast<int>(i)));
+    }
+    for(int rep = 0; rep < reps; ++rep) {
+        Map flat;
+        best[0] = min(best[0], timeMs([&]() {
+            load(flat, items);
+        }));
+        best[1] = min(best[1], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                checksum += flat.find(keys[i])->second;
+            }
+        }));
+        best[2] = min(best[2], timeMs([&]() {
+            for(typename Map::iterator it = flat.begin(); it != flat.end(); ++it) {
+                checksum += it->second;
+            }
+        }));
+    }
+
+    const char* names[3] = {"bulkload", "find", "iterate"};
+    for(int op = 0; op < 3; ++op) {
+        report(structure, distribution, names[op], n, best[op]);
+    }
+}
+
+// An AVLTree behind one mutex, the way it was shared between threads
+// before ConcurrentAVLTree.
+class LockedAVLTree
+{
+public:
+    void insert(const pair<const int, int>& item)
+    {
+        lock_guard<mutex> guard(lock_);
+        tree_.insert(item);
+    }
+    void remove(int key)
+    {
+        lock_guard<mutex> guard(lock_);
+        tree_.remove(key);
+    }
+    bool find(int key, int& value) const
+    {
+        lock_guard<mutex> guard(lock_);
+        AVLTree<int, int>::iterator it = tree_.find(key);
+        if(it == tree_.end()) return false;
+        value = it->second;
+        return true;
+    }
+
+private:
+    AVLTree<int, int> tree_;
+    mutable mutex lock_;
+};
+
+// Splits n lookups over 1, 2, 4, ... reader threads (up to the number of
+// cores) while one writer keeps inserting and removing keys now and then.
+// ns_per_op is wall time over all lookups, so it falls as throughput grows.
+template<typename Tree>
+void benchConcurrent(const char* structure, const char* distribution, const vector<int>& keys)
+{
+    const size_t n = keys.size();
+    unsigned cores = max(1u, thread::hardware_concurrency());
+
+    Tree tree;
+    for(size_t i = 0; i < n; ++i) {
+        tree.insert(make_pair(keys[i], static_cast<int>(i)));
+    }
+    for(unsigned readers = 1; ; readers = min(readers * 2, cores)) {
+        atomic<bool> stop(false);
+        thread writer([&]() {
+            mt19937 rng(7);
+            while(!stop) {
+                int key = keys[rng() % n];
+                tree.remove(key);
+                tree.insert(make_pair(key, 0));
+                this_thread::sleep_for(chrono::microseconds(100));
+            }
+        });
+        double ms = timeMs([&]() {
+            vector<thread> threads;
+            for(unsigned t = 0; t < readers; ++t) {
+                threads.push_back(thread([&, t]() {
+                    long long sum = 0;
+                    for(size_t i = t; i < n; i += readers) {
+                        int value;
+                        if(tree.find(keys[i], value)) sum += value;
+                    }
+                    static mutex checksumLock;
+                    lock_guard<mutex> guard(checksumLock);
+                    checksum += sum;
+                }));
+            }
+            for(size_t t = 0; t < threads.size(); ++t) {
+                threads[t].join();
+            }
+        });
+        stop = true;
+        writer.join();
+
+        string operation = "find-" + to_string(readers) + "threads";
+        report(structure, distribution, operation.c_str(), n, ms);
+        if(readers == cores) break;
+    }
+}
+
+// Times PersistentAVLTree inserts (which copy the path to each key), finds
+// and snapshots. Then keeps ten snapshots, each 1% of the keys of updates
+// apart, and compares the nodes they hold between them with what ten full
+// copies of the tree would hold.
+void benchPersistent(const char* distribution, const vector<int>& keys, int reps)
+{
+    typedef PersistentAVLTree<int, int> Tree;
+    const size_t n = keys.size();
+    double best[3] = {1e300, 1e300, 1e300};
+
+    for(int rep = 0; rep < reps; ++rep) {
+        Tree tree;
+        best[0] = min(best[0], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                tree.insert(make_pair(keys[i], static_cast<int>(i)));
+            }
+        }));
+        best[1] = min(best[1], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                checksum += tree.find(keys[i])->second;
+            }
+        }));
+        vector<Tree> snapshots(n);
+        best[2] = min(best[2], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                snapshots[i] = tree.snapshot();
+            }
+        }));
+    }
+    report("PersistentAVLTree", distribution, "insert", n, best[0]);
+    report("PersistentAVLTree", distribution, "find", n, best[1]);
+    report("PersistentAVLTree", distribution, "snapshot", n, best[2]);
+
+    Tree tree;
+    for(size_t i = 0; i < n; ++i) {
+        tree.insert(make_pair(keys[i], static_cast<int>(i)));
+    }
+    vector<Tree> snapshots;
+    size_t copied = 0;
+    mt19937 rng(11);
+    for(int s = 0; s < 10; ++s) {
+        snapshots.push_back(tree.snapshot());
+        copied += tree.size();
+        for(size_t i = 0; i < n / 100; ++i) {
+            tree.insert(make_pair(keys[rng() % n], s));
+        }
+    }
+    cerr << "PersistentAVLTree " << distribution << ": 10 snapshots hold " << Tree::liveNodes()
+         << " nodes, full copies would hold " << copied << endl;
+}
+
+// Merges a tree of m of the keys into one of the other n - m, by
+// unionWith and by inserting the m items one at a time, for m small
+// against n and m about n. The trees are rebuilt untimed before each rep.
+void benchUnion(const char* distribution, const vector<int>& keys, int reps)
+{
+    typedef AVLTree<int, int> Tree;
+    const size_t n = keys.size();
+    const size_t sizes[2] = {n / 100, n / 2};
+    const char* names[2][2] = {{"union-join-1%", "union-insert-1%"}, {"union-join-50%", "union-insert-50%"}};
+
+    for(int s = 0; s < 2; ++s) {
+        const size_t m = sizes[s];
+        double best[2] = {1e300, 1e300};
+        for(int rep = 0; rep < reps; ++rep) {
+            Tree big;
+            Tree small;
+            for(size_t i = 0; i < n - m; ++i) {
+                big.insert(make_pair(keys[i], static_cast<int>(i)));
+            }
+            for(size_t i = n - m; i < n; ++i) {
+                small.insert(make_pair(keys[i], static_cast<int>(i)));
+            }
+            best[0] = min(best[0], timeMs([&]() {
+                big.unionWith(small);
+            }));
+            checksum += big.size();
+
+            Tree other;
+            for(size_t i = 0; i < n - m; ++i) {
+                other.insert(make_pair(keys[i], static_cast<int>(i)));
+            }
+            best[1] = min(best[1], timeMs([&]() {
+                for(size_t i = n - m; i < n; ++i) {
+                    other.insert(make_pair(keys[i], static_cast<int>(i)));
+                }
+            }));
+            checksum += other.size();
+        }
+        report("AVLTree", distribution, names[s][0], m, best[0]);
+        report("AVLTree", distribution, names[s][1], m, best[1]);
+    }
+}
+
+// Builds an AVLTree from the keys in their given order with the range
+// constructor and with its parallel sort-then-build version, then sums
+// every value with an iterator loop and with parallelForEach.
+void benchParallel(const char* distribution, const vector<int>& keys, int reps)
+{
+    typedef AVLTree<int, int> Tree;
+    const size_t n = keys.size();
+    vector<pair<int, int> > items(n);
+    for(size_t i = 0; i < n; ++i) {
+        items[i] = make_pair(keys[i], static_cast<int>(i));
+    }
+    double best[4] = {1e300, 1e300, 1e300, 1e300};
+
+    for(int rep = 0; rep < reps; ++rep) {
+        best[0] = min(best[0], timeMs([&]() {
+            Tree tree(items.begin(), items.end());
+            checksum += tree.size();
+        }));
+        best[1] = min(best[1], timeMs([&]() {
+            Tree tree(ParallelTag(), items.begin(), items.end());
+            checksum += tree.size();
+        }));
+
+        Tree tree(items.begin(), items.end());
+        best[2] = min(best[2], timeMs([&]() {
+            long long sum = 0;
+            for(Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+                sum += it->second;
+            }
+            checksum += sum;
+        }));
+        best[3] = min(best[3], timeMs([&]() {
+            atomic<long long> sum(0);
+            tree.parallelForEach([&sum](const pair<const int, int>& item) {
+                sum.fetch_add(item.second, memory_order_relaxed);
+            });
+            checksum += sum.load();
+        }));
+    }
+    report("AVLTree", distribution, "build", n, best[0]);
+    report("AVLTree", distribution, "build-parallel", n, best[1]);
+    report("AVLTree", distribution, "scan", n, best[2]);
+    report("AVLTree", distribution, "scan-parallel", n, best[3]);
+}
+
+// Compares AVLTree's nodes, which have parent pointers, with StackAVLTree's,
+// which do not, CompactAVLTree's 32-bit index links and ScapegoatTree's,
+// which have no balance field: inserts, lookups through operator[] (which
+// need no iterator), a full scan and removes.
+template<typename Tree>
+void benchLayout(const char* structure, const char* distribution, const vector<int>& keys, int reps)
+{
+    const size_t n = keys.size();
+    double best[4] = {1e300, 1e300, 1e300, 1e300};
+
+    for(int rep = 0; rep < reps; ++rep) {
+        Tree tree;
+        best[0] = min(best[0], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                tree.insert(make_pair(keys[i], static_cast<int>(i)));
+            }
+        }));
+        best[1] = min(best[1], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                checksum += tree[keys[i]];
+            }
+        }));
+        best[2] = min(best[2], timeMs([&]() {
+            for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+                checksum += it->second;
+            }
+        }));
+        best[3] = min(best[3], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                tree.remove(keys[i]);
+            }
+        }));
+    }
+
+    const char* names[4] = {"layout-insert", "layout-lookup", "layout-iterate", "layout-remove"};
+    for(int op = 0; op < 4; ++op) {
+        report(structure, distribution, names[op], n, best[op]);
+    }
+}
+
+// Mixes of updates and lookups over a sliding window of keys: the tree
+// starts with the first half of keys, and each update either inserts the
+// next key past the window or removes the oldest one in it, so the size
+// stays about the same. mix-churn is 90% updates, mix-read 10%.
+template<typename Tree>
+void benchMix(const char* structure, const char* distribution, const vector<int>& keys, int reps)
+{
+    const size_t n = keys.size();
+    const size_t half = n / 2;
+    const int updatePercent[2] = {90, 10};
+    const char* names[2] = {"mix-churn", "mix-read"};
+
+    for(int mix = 0; mix < 2; ++mix) {
+        double best = 1e300;
+        for(int rep = 0; rep < reps; ++rep) {
+            Tree tree;
+            for(size_t i = 0; i < half; ++i) {
+                tree.insert(make_pair(keys[i], static_cast<int>(i)));
+            }
+            best = min(best, timeMs([&]() {
+                size_t oldest = 0;
+                size_t next = half;
+                for(size_t i = 0; i < n; ++i) {
+                    if(static_cast<int>(i % 100) < updatePercent[mix] && next < n) {
+                        if(i % 2 == 0) {
+                            tree.insert(make_pair(keys[next], static_cast<int>(i)));
+                            ++next;
+                        }
+                        else {
+                            tree.remove(keys[oldest]);
+                            ++oldest;
+                        }
+                    }
+                    else {
+                        size_t window = next - oldest;
+                        typename Tree::iterator it = tree.find(keys[oldest + (i * 2654435761u) % window]);
+                        if(it != tree.end()) checksum += it->second;
+                    }
+                }
+            }));
+        }
+        report(structure, distribution, names[mix], n, best);
+    }
+}
+
+// Inserts every key, then looks them all up in stream order, once searching
+// from the root and once from the previous lookup's result as a hint.
+void benchHinted(const char* distribution, const vector<int>& keys, int reps)
+{
+    typedef AVLTree<int, int> Tree;
+    const size_t n = keys.size();
+    double best[2] = {1e300, 1e300};
+
+    Tree tree;
+    for(size_t i = 0; i < n; ++i) {
+        tree.insert(make_pair(keys[i], static_cast<int>(i)));
+    }
+    for(int rep = 0; rep < reps; ++rep) {
+        best[0] = min(best[0], timeMs([&]() {
+            for(size_t i = 0; i < n; ++i) {
+                checksum += tree.find(keys[i])->second;
+            }
+        }));
+        best[1] = min(best[1], timeMs([&]() {
+            Tree::iterator hint = tree.end();
+            for(size_t i = 0; i < n; ++i) {
+                hint = tree.find(hint, keys[i]);
+                checksum += hint->second;
+            }
+        }));
+    }
+
+    const char* names[2] = {"find", "find-hint"};
+    for(int op = 0; op < 2; ++op) {
+        report("AVLTree", distribution, names[op], n, best[op]);
+    }
+}
+
+// In a BST_STATS build, reports the work behind a balanced tree's insert,
+// find, scan and remove rows: rotations, fix-up steps, comparisons and
+// successor climbs per operation, and how deep the lookups went. Untimed,
+// the counters would skew the timings.
+template<typename Tree>
+void benchStats(const char* structure, const char* distribution, const vector<int>& keys)
+{
+    if(!TreeStats::ENABLED) return;
+    const size_t n = keys.size();
+    // counters are cumulative, so each phase is the difference between the
+    // snapshots either side of it
+    Tree tree;
+    for(size_t i = 0; i < n; ++i) {
+        tree.insert(make_pair(keys[i], static_cast<int>(i)));
+    }
+    TreeStats inserted = tree.stats();
+    for(size_t i = 0; i < n; ++i) {
+        checksum += tree.find(keys[i])->second;
+    }
+    TreeStats found = tree.stats();
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        checksum += it->second;
+    }
+    TreeStats scanned = tree.stats();
+    for(size_t i = 0; i < n; ++i) {
+        tree.remove(keys[i]);
+    }
+    TreeStats stats = tree.stats();
+
+    double per = (n == 0) ? 0.0 : 1.0 / n;
+    cerr << structure << ' ' << distribution << " per op:"
+         << " insert rotations " << inserted.rotations * per
+         << ", insertFix steps " << inserted.insertFixSteps * per
+         << ", find comparisons " << (found.comparisons - inserted.comparisons) * per
+         << ", scan successor climbs " << (scanned.successorClimbs - found.successorClimbs) * per
+         << ", remove rotations " << (stats.rotations - scanned.rotations) * per
+         << ", removeFix steps " << (stats.removeFixSteps - scanned.removeFixSteps) * per << endl;
+    cerr << structure << ' ' << distribution << " find depths:";
+    for(int depth = 0; depth < TreeStats::MAX_DEPTH; ++depth) {
+        unsigned long long count = found.depthHistogram[depth] - inserted.depthHistogram[depth];
+        if(count != 0) {
+            cerr << ' ' << depth << ':' << count;
+        }
+    }
+    cerr << endl;
+}
+
+// Runs every structure over one key distribution.
+void benchDistribution(const char* distribution, const vector<int>& keys, int reps)
+{
+    // sorted input degenerates the unbalanced tree into a list, so
+    // keep its run short enough to finish
+    vector<int> bstKeys = keys;
+    if(strcmp(distribution, "sorted") == 0 && bstKeys.size() > 20000) {
+        bstKeys.resize(20000);
+    }
+    benchOne<BinarySearchTree<int, int> >("BinarySearchTree", distribution, bstKeys, reps);
+    benchOne<AVLTree<int, int> >("AVLTree", distribution, keys, reps);
+    benchOne<RedBlackTree<int, int> >("RedBlackTree", distribution, keys, reps);
+    benchOne<ScapegoatTree<int, int> >("ScapegoatTree", distribution, keys, reps);
+    // the zipf rows are the skewed trace, random the uniform one
+    benchOne<SplayTree<int, int> >("SplayTree", distribution, keys, reps);
+    benchOne<SemiSplayTree>("SplayTree(semi)", distribution, keys, reps);
+    benchOne<BTreeMap<int, int> >("BTreeMap", distribution, keys, reps);
+    benchOne<map<int, int> >("std::map", distribution, keys, reps);
+    benchBatch<BinarySearchTree<int, int> >("BinarySearchTree", distribution, bstKeys, reps);
+    benchBatch<AVLTree<int, int> >("AVLTree", distribution, keys, reps);
+    benchFrozen(distribution, keys, reps);
+    benchFlat<FlatSortedMap<int, int> >("FlatSortedMap", distribution, keys, reps);
+    benchFlat<FlatSortedMap<int, int, ScalarLess> >("FlatSortedMap(scalar)", distribution, keys, reps);
+    benchPersistent(distribution, keys, reps);
+    benchUnion(distribution, keys, reps);
+    benchParallel(distribution, keys, reps);
+    benchMix<AVLTree<int, int> >("AVLTree", distribution, keys, reps);
+    benchMix<RedBlackTree<int, int> >("RedBlackTree", distribution, keys, reps);
+    benchLayout<AVLTree<int, int> >("AVLTree", distribution, keys, reps);
+    benchLayout<StackAVLTree<int, int> >("StackAVLTree", distribution, keys, reps);
+    benchLayout<CompactAVLTree<int, int> >("CompactAVLTree", distribution, keys, reps);
+    benchLayout<ScapegoatTree<int, int> >("ScapegoatTree", distribution, keys, reps);
+    benchConcurrent<LockedAVLTree>("AVLTree+mutex", distribution, keys);
+    benchConcurrent<ConcurrentAVLTree<int, int> >("ConcurrentAVLTree", distribution, keys);
+    benchStats<AVLTree<int, int> >("AVLTree", distribution, keys);
+    benchStats<RedBlackTree<int, int> >("RedBlackTree", distribution, keys);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = 1000000;
+    int reps = 3;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--quick") == 0) {
+            // small run, used as the training workload for PGO builds
+            n = 50000;
+            reps = 1;
+        }
+        else {
+            n = strtoul(argv[i], NULL, 10);
+        }
+    }
+
+    mt19937 rng(42);
+    cout << "structure,distribution,operation,n,total_ms,ns_per_op" << endl;
+    benchDistribution("random", randomKeys(n, rng), reps);
+    benchDistribution("sorted", sortedKeys(n), reps);
+    benchDistribution("zipf", zipfKeys(n, rng), reps);
+    benchHinted("sorted", sortedKeys(n), reps);
+    benchHinted("nearly-sorted", nearlySortedKeys(n, rng), reps);
+    benchHinted("random", randomKeys(n, rng), reps);
+
+    cerr << "search kernel " << flatSearchLevelName(flatSearchLevel()) << endl;
+    cerr << "bytes per node: AVLTree " << NodePool(sizeof(AVLNode<int, int>)).blockSize()
+         << ", StackAVLTree " << StackAVLTree<int, int>::nodeBytes()
+         << ", CompactAVLTree " << CompactAVLTree<int, int>::nodeBytes()
+         << ", ScapegoatTree " << ScapegoatTree<int, int>::nodeBytes() << endl;
+    cerr << "thread pool workers " << ThreadPool::shared().workers() << endl;
+    cerr << "checksum " << checksum << endl;
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <string>
+#include <utility>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+// Builds the same degenerate chain an unbalanced tree gets from sorted
+// inserts, but in O(n) so the teardown can be stressed at full size.
+template<typename Key, typename Value>
+class ChainTree : public BinarySearchTree<Key, Value>
+{
+public:
+    void appendSorted(int n, const Value& value)
+    {
+        Node<Key, Value>* last = this->root_;
+        while(last != nullptr && last->getRight() != nullptr) {
+            last = last->getRight();
+        }
+        for(int i = 0; i < n; ++i) {
+            Node<Key, Value>* next = this->template createNode<Node<Key, Value> >(i, value, last);
+            if(last == nullptr) this->root_ = next;
+            else last->setRight(next);
+            last = next;
+        }
+    }
+};
+
+int main()
+{
+    const int n = 10000000;
+
+    // a 10M deep chain would overflow the stack with a recursive clear()
+    {
+        ChainTree<int, string> chain;
+        chain.appendSorted(n, "value that needs a destructor");
+        cout << "Built " << n << " node chain" << endl;
+        chain.clear();
+        cout << "Cleared chain, empty: " << chain.empty() << endl;
+        chain.appendSorted(n, "reused");
+        cout << "Rebuilt chain, destroying" << endl;
+    }
+
+    {
+        AVLTree<int, int> tree;
+        for(int i = 0; i < n; ++i) {
+            tree.insert(make_pair(i, i));
+        }
+        cout << "Inserted " << n << " sorted keys into AVLTree, balanced: " << tree.isBalanced() << endl;
+    }
+    cout << "Destroyed AVLTree" << endl;
+    return 0;
+}
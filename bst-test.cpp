@@ -1,10 +1,1608 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 #include "bst.h"
 #include "avlbst.h"
+#include "btree.h"
+#include "compact_avl.h"
+#include "concurrent_avl.h"
+#include "persistent_avl.h"
+#include "rbbst.h"
+#include "scapegoat_tree.h"
+#include "splay_tree.h"
+#include "stack_avl.h"
+#include "flat_sorted_map.h"
 
 using namespace std;
 
+// Checks that fail are counted so that main can exit non-zero
+int failures = 0;
+
+void report(const char* msg, bool ok)
+{
+    cout << msg << ": " << (ok ? "passed" : "FAILED") << endl;
+    if(!ok) ++failures;
+}
+
+// Reaches the protected root of any tree built on BinarySearchTree, so the
+// checks below can walk its nodes
+template<typename Key, typename Value, typename Compare = std::less<Key> >
+struct TreeRoot : BinarySearchTree<Key, Value, Compare>
+{
+    static Node<Key, Value>* of(const BinarySearchTree<Key, Value, Compare>& tree)
+    {
+        return tree.*(&TreeRoot::root_);
+    }
+};
+
+// Checks parent links and subtree sizes under n. Returns the height of n's
+// subtree, or -1 if anything is wrong. Key order is checked by comparing an
+// in-order walk with a std::map, see sameAsMap.
+template<typename Key, typename Value>
+int checkLinks(const Node<Key, Value>* n, const Node<Key, Value>* parent)
+{
+    if(n == nullptr) return 0;
+    if(n->getParent() != parent) return -1;
+    int left = checkLinks(n->getLeft(), n);
+    int right = checkLinks(n->getRight(), n);
+    if(left < 0 || right < 0) return -1;
+    size_t size = 1;
+    if(n->getLeft() != nullptr) size += n->getLeft()->getSize();
+    if(n->getRight() != nullptr) size += n->getRight()->getSize();
+    if(n->getSize() != size) return -1;
+    return 1 + max(left, right);
+}
+
+// Checks every balance under n is its right height minus its left height
+// and within one. Returns the height, or -1.
+template<typename Key, typename Value>
+int checkAVL(const AVLNode<Key, Value>* n)
+{
+    if(n == nullptr) return 0;
+    int left = checkAVL(n->getLeft());
+    int right = checkAVL(n->getRight());
+    if(left < 0 || right < 0) return -1;
+    if(n->getBalance() != right - left || abs(right - left) > 1) return -1;
+    return 1 + max(left, right);
+}
+
+template<typename Key, typename Value, typename Compare>
+int heightOf(const BinarySearchTree<Key, Value, Compare>& tree)
+{
+    return checkLinks(TreeRoot<Key, Value, Compare>::of(tree), static_cast<const Node<Key, Value>*>(nullptr));
+}
+
+template<typename Key, typename Value, typename Compare>
+bool isAVL(const BinarySearchTree<Key, Value, Compare>& tree)
+{
+    Node<Key, Value>* root = TreeRoot<Key, Value, Compare>::of(tree);
+    return checkLinks(root, static_cast<Node<Key, Value>*>(nullptr)) >= 0
+           && checkAVL(static_cast<AVLNode<Key, Value>*>(root)) >= 0;
+}
+
+// True if [it, end) holds exactly the items of expected, in the same order
+template<typename Iterator, typename Map>
+bool sameItems(Iterator it, Iterator end, const Map& expected)
+{
+    for(typename Map::const_iterator e = expected.begin(); e != expected.end(); ++e, ++it) {
+        if(it == end || it->first != e->first || it->second != e->second) return false;
+    }
+    return it == end;
+}
+
+template<typename Tree, typename Map>
+bool sameAsMap(const Tree& tree, const Map& expected)
+{
+    return tree.size() == expected.size() && sameItems(tree.begin(), tree.end(), expected);
+}
+
+// One random insert (possibly overwriting) or remove, applied to both tree
+// and expected, plus a lookup checked against expected
+template<typename Tree, typename Map>
+bool randomUpdate(Tree& tree, Map& expected, mt19937& rng, int keyRange)
+{
+    int key = static_cast<int>(rng() % keyRange);
+    if(rng() % 5 < 3) {
+        int value = static_cast<int>(rng() % 1000);
+        tree.insert(std::make_pair(key, value));
+        expected[key] = value;
+    }
+    else {
+        tree.remove(key);
+        expected.erase(key);
+    }
+    key = static_cast<int>(rng() % keyRange);
+    typename Tree::iterator it = tree.find(key);
+    typename Map::iterator e = expected.find(key);
+    if(e == expected.end()) return it == tree.end();
+    return it != tree.end() && it->second == e->second;
+}
+
+// A BinarySearchTree holding 0 .. n - 1 as one chain of right children,
+// the shape ascending inserts give, linked directly rather than inserted
+// since each insert would walk the whole chain
+struct ChainTree : BinarySearchTree<int, int>
+{
+    explicit ChainTree(int n)
+    {
+        Node<int, int>* last = nullptr;
+        for(int key = 0; key < n; ++key) {
+            Node<int, int>* node = createNode<Node<int, int> >(key, key, last);
+            if(last == nullptr) root_ = node;
+            else last->setRight(node);
+            last = node;
+        }
+        for(size_t size = 1; last != nullptr; ++size, last = last->getParent()) {
+            last->setSize(size);
+        }
+    }
+};
+
+// parallelForEach on a private pool with workers, so the forking path runs
+// even on a single core, over a chain several times PARALLEL_GRAIN long:
+// the walk must not recurse once per node
+void testParallelChain(const char* msg)
+{
+    const int n = 200000;
+    ChainTree chain(n);
+    ThreadPool pool(3);
+    mutex lock;
+    vector<int> seen;
+    chain.parallelForEach([&lock, &seen](const std::pair<const int, int>& item) {
+        lock_guard<mutex> guard(lock);
+        seen.push_back(item.first);
+    }, pool);
+    sort(seen.begin(), seen.end());
+    bool ok = chain.size() == static_cast<size_t>(n) && static_cast<int>(seen.size()) == n;
+    for(int key = 0; ok && key < n; ++key) {
+        ok = seen[key] == key;
+    }
+    report(msg, ok);
+}
+
+// Random updates against a std::map on a tree that starts empty, checking
+// the items, and the AVL invariants, every so often; then removes every key
+// in random order
+void testAVLUpdates(const char* msg)
+{
+    mt19937 rng(1);
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    bool ok = true;
+    for(int round = 0; round < 20; ++round) {
+        for(int i = 0; i < 500; ++i) {
+            ok = randomUpdate(tree, expected, rng, 2000) && ok;
+        }
+        ok = ok && sameAsMap(tree, expected) && isAVL(tree) && tree.isBalanced();
+    }
+    vector<int> keys;
+    for(map<int, int>::iterator it = expected.begin(); it != expected.end(); ++it) {
+        keys.push_back(it->first);
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.remove(keys[i]);
+        expected.erase(keys[i]);
+        if(i % 50 == 0) ok = ok && sameAsMap(tree, expected) && isAVL(tree);
+    }
+    report(msg, ok && tree.empty());
+}
+
+// Sorted, unsorted and duplicate-key input to the range constructors and
+// bulkLoad, which must build a tree of the least possible height
+void testBulkLoad(const char* msg)
+{
+    mt19937 rng(2);
+    bool ok = true;
+    for(int n = 0; n <= 1000; n = n * 2 + 1) {
+        vector<pair<int, int> > items;
+        map<int, int> expected;
+        for(int i = 0; i < n; ++i) {
+            items.push_back(std::make_pair(i * 3, i));
+            expected[i * 3] = i;
+        }
+        int least = 0;
+        while((1 << least) <= n) ++least;
+
+        AVLTree<int, int> sorted(items.begin(), items.end());
+        ok = ok && sameAsMap(sorted, expected) && isAVL(sorted) && heightOf(sorted) == least;
+
+        //later duplicates overwrite earlier ones, as insert does
+        for(int i = 0; i < n / 4; ++i) {
+            int key = static_cast<int>(rng() % (3 * n));
+            items.push_back(std::make_pair(key, -i));
+            expected[key] = -i;
+        }
+        shuffle(items.begin(), items.end(), rng);
+        expected.clear();
+        for(size_t i = 0; i < items.size(); ++i) {
+            expected[items[i].first] = items[i].second;
+        }
+        AVLTree<int, int> shuffled;
+        shuffled.insert(std::make_pair(-1, -1));
+        shuffled.bulkLoad(items.begin(), items.end());
+        least = 0;
+        while((1u << least) <= expected.size()) ++least;
+        ok = ok && sameAsMap(shuffled, expected) && isAVL(shuffled) && heightOf(shuffled) == least;
+
+        BinarySearchTree<int, int> plain(items.begin(), items.end());
+        ok = ok && sameAsMap(plain, expected) && heightOf(plain) == least;
+
+        //the balances from the build must hold up under further updates
+        for(int i = 0; i < 200; ++i) {
+            ok = randomUpdate(shuffled, expected, rng, 3 * n + 1) && ok;
+        }
+        ok = ok && sameAsMap(shuffled, expected) && isAVL(shuffled);
+    }
+    report(msg, ok);
+}
+
+// Random calls to each way of adding a key, whose results must say whether
+// the key was new and point at it; emplace and try_emplace leave an
+// existing value alone, insert and insert_or_assign overwrite it
+template<typename Tree>
+bool randomEmplace(Tree& tree, map<int, int>& expected, mt19937& rng, int keyRange)
+{
+    int key = static_cast<int>(rng() % keyRange);
+    int value = static_cast<int>(rng() % 1000);
+    bool isNew = expected.find(key) == expected.end();
+    pair<typename Tree::iterator, bool> result;
+    switch(rng() % 5) {
+    case 0:
+        tree.insert(std::make_pair(key, value));
+        expected[key] = value;
+        return true;
+    case 1:
+        tree.remove(key);
+        expected.erase(key);
+        return true;
+    case 2:
+        result = tree.emplace(key, value);
+        break;
+    case 3:
+        result = tree.try_emplace(key, value);
+        break;
+    default:
+        result = tree.insert_or_assign(key, value);
+        expected[key] = value;
+        break;
+    }
+    if(isNew) expected[key] = value;
+    return result.second == isNew && result.first != tree.end() && result.first->first == key
+           && result.first->second == expected[key];
+}
+
+// A value that counts how it was made, to check the map operations move
+// rather than copy and construct nothing for a key already present
+struct Tracked
+{
+    static int constructed;
+    static int copied;
+    static int moved;
+    static void reset() { constructed = copied = moved = 0; }
+
+    explicit Tracked(int id = 0) : id(id) { ++constructed; }
+    Tracked(const Tracked& other) : id(other.id) { ++copied; }
+    Tracked(Tracked&& other) : id(other.id) { ++moved; }
+    Tracked& operator=(const Tracked& other)
+    {
+        id = other.id;
+        ++copied;
+        return *this;
+    }
+    Tracked& operator=(Tracked&& other)
+    {
+        id = other.id;
+        ++moved;
+        return *this;
+    }
+
+    int id;
+};
+int Tracked::constructed = 0;
+int Tracked::copied = 0;
+int Tracked::moved = 0;
+
+// For BinarySearchTree::print
+ostream& operator<<(ostream& out, const Tracked& value)
+{
+    return out << value.id;
+}
+
+// How many Values each operation makes, and that an existing key keeps its
+// node. Returns true if every count is as expected.
+template<typename Tree>
+bool countValueWork(Tree& tree)
+{
+    bool ok = true;
+    for(int key = 0; key < 100; key += 2) {
+        Tracked::reset();
+        tree.insert(std::make_pair(key, Tracked(key)));
+        ok = ok && Tracked::copied == 0;
+    }
+    typename Tree::iterator existing = tree.find(10);
+
+    Tracked::reset();
+    pair<typename Tree::iterator, bool> result = tree.try_emplace(10, 99);
+    ok = ok && !result.second && result.first == existing && existing->second.id == 10;
+    ok = ok && Tracked::constructed == 0 && Tracked::copied == 0 && Tracked::moved == 0;
+
+    Tracked::reset();
+    result = tree.try_emplace(11, 11);
+    ok = ok && result.second && result.first->second.id == 11;
+    ok = ok && Tracked::constructed == 1 && Tracked::copied == 0 && Tracked::moved == 0;
+
+    //emplace has to build the pair to learn the key, but makes no node
+    Tracked::reset();
+    result = tree.emplace(10, 98);
+    ok = ok && !result.second && result.first == existing && existing->second.id == 10;
+    ok = ok && Tracked::copied == 0 && Tracked::moved == 0;
+
+    Tracked::reset();
+    result = tree.insert_or_assign(10, Tracked(97));
+    ok = ok && !result.second && result.first == existing && existing->second.id == 97;
+    ok = ok && Tracked::copied == 0 && Tracked::moved == 1;
+
+    Tracked::reset();
+    result = tree.insert_or_assign(13, Tracked(13));
+    ok = ok && result.second && result.first->second.id == 13 && Tracked::copied == 0;
+    return ok && tree.size() == 52;
+}
+
+// emplace, try_emplace and insert_or_assign against a std::map, directly
+// and through a BinarySearchTree reference to an AVLTree, and the copies,
+// moves and constructions they make
+void testEmplace(const char* msg)
+{
+    mt19937 rng(4);
+    bool ok = true;
+    AVLTree<int, int> avl;
+    BinarySearchTree<int, int> plain;
+    map<int, int> expectedAVL;
+    map<int, int> expectedPlain;
+    for(int i = 0; i < 5000; ++i) {
+        ok = randomEmplace(avl, expectedAVL, rng, 1000) && ok;
+        ok = randomEmplace(plain, expectedPlain, rng, 1000) && ok;
+    }
+    ok = ok && sameAsMap(avl, expectedAVL) && isAVL(avl);
+    ok = ok && sameAsMap(plain, expectedPlain) && heightOf(plain) >= 0;
+
+    //through a base reference the AVLTree must still make AVLNodes
+    AVLTree<int, int> viaBase;
+    BinarySearchTree<int, int>& base = viaBase;
+    map<int, int> expectedBase;
+    for(int i = 0; i < 5000; ++i) {
+        ok = randomEmplace(base, expectedBase, rng, 1000) && ok;
+    }
+    ok = ok && sameAsMap(viaBase, expectedBase) && isAVL(viaBase);
+
+    AVLTree<int, Tracked> trackedAVL;
+    BinarySearchTree<int, Tracked> trackedPlain;
+    ok = ok && countValueWork(trackedAVL) && countValueWork(trackedPlain) && isAVL(trackedAVL);
+    report(msg, ok);
+}
+
+// Turns a tree iterator into the key it is at, or end for the end
+template<typename Tree>
+int keyAt(const Tree& tree, typename Tree::iterator it, int end)
+{
+    return it == tree.end() ? end : it->first;
+}
+
+// lower_bound, upper_bound, equal_range and forEachInRange for keys in,
+// between and around the tree's keys, against std::map
+template<typename Tree>
+bool boundsMatch(const Tree& tree, const map<int, int>& expected, mt19937& rng, int keyRange)
+{
+    const int END = -1000;
+    bool ok = true;
+    for(int key = -2; key < keyRange + 2; ++key) {
+        map<int, int>::const_iterator lower = expected.lower_bound(key);
+        map<int, int>::const_iterator upper = expected.upper_bound(key);
+        int lowerKey = lower == expected.end() ? END : lower->first;
+        int upperKey = upper == expected.end() ? END : upper->first;
+        ok = ok && keyAt(tree, tree.lower_bound(key), END) == lowerKey;
+        ok = ok && keyAt(tree, tree.upper_bound(key), END) == upperKey;
+        pair<typename Tree::iterator, typename Tree::iterator> range = tree.equal_range(key);
+        ok = ok && keyAt(tree, range.first, END) == lowerKey && keyAt(tree, range.second, END) == upperKey;
+    }
+    for(int i = 0; i < 200; ++i) {
+        int lo = static_cast<int>(rng() % (keyRange + 4)) - 2;
+        int hi = lo + static_cast<int>(rng() % (keyRange / 4 + 1)) - 2;
+        vector<pair<int, int> > seen;
+        tree.forEachInRange(lo, hi, [&seen](const pair<const int, int>& item) {
+            seen.push_back(item);
+        });
+        vector<pair<int, int> > wanted;
+        if(lo < hi) {
+            wanted.assign(expected.lower_bound(lo), expected.lower_bound(hi));
+        }
+        ok = ok && seen == wanted;
+    }
+    return ok;
+}
+
+// Ordered queries on trees of several sizes, empty included, and after
+// removes have reshaped them
+void testBounds(const char* msg)
+{
+    mt19937 rng(5);
+    bool ok = true;
+    for(int n = 0; n <= 400; n = n * 3 + 1) {
+        AVLTree<int, int> tree;
+        BinarySearchTree<int, int> plain;
+        map<int, int> expected;
+        for(int i = 0; i < n; ++i) {
+            int key = static_cast<int>(rng() % (4 * n));
+            tree.insert(std::make_pair(key, i));
+            plain.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+        ok = ok && boundsMatch(tree, expected, rng, 4 * n) && boundsMatch(plain, expected, rng, 4 * n);
+        for(int i = 0; i < n / 2; ++i) {
+            int key = static_cast<int>(rng() % (4 * n));
+            tree.remove(key);
+            expected.erase(key);
+        }
+        ok = ok && boundsMatch(tree, expected, rng, 4 * n);
+    }
+    report(msg, ok);
+}
+
+// The fewest items a B+ tree of the given height can hold with every node
+// but the root at least half full
+template<typename Tree>
+size_t fewestItems(int height)
+{
+    if(height <= 1) return height;
+    size_t items = 2 * (Tree::LEAF_SLOTS / 2);
+    for(int level = 2; level < height; ++level) {
+        items *= Tree::INNER_SLOTS / 2 + 1;
+    }
+    return items;
+}
+
+// Walks tree backwards from its largest key, comparing with expected
+template<typename Tree>
+bool sameBackwards(const Tree& tree, const map<int, int>& expected)
+{
+    if(expected.empty()) return tree.begin() == tree.end();
+    typename Tree::iterator it = tree.find(expected.rbegin()->first);
+    for(map<int, int>::const_reverse_iterator e = expected.rbegin(); e != expected.rend(); ++e, --it) {
+        if(it == tree.end() || it->first != e->first || it->second != e->second) return false;
+    }
+    return it == tree.end();
+}
+
+// BTreeMap under enough random updates to split and merge nodes at every
+// level, and after bulkLoad, against a std::map: items both ways round,
+// and a height no node under half full would allow
+void testBTree(const char* msg)
+{
+    typedef BTreeMap<int, int> Tree;
+    mt19937 rng(6);
+    bool ok = true;
+    Tree tree;
+    map<int, int> expected;
+    for(int round = 0; round < 10; ++round) {
+        for(int i = 0; i < 3000; ++i) {
+            ok = randomUpdate(tree, expected, rng, 5000) && ok;
+        }
+        ok = ok && sameAsMap(tree, expected) && sameBackwards(tree, expected);
+        ok = ok && fewestItems<Tree>(tree.height()) <= tree.size();
+    }
+    //then shrink, merging nodes back down to an empty tree
+    while(!expected.empty()) {
+        for(int i = 0; i < 100 && !expected.empty(); ++i) {
+            map<int, int>::iterator victim = expected.lower_bound(static_cast<int>(rng() % 5000));
+            if(victim == expected.end()) victim = expected.begin();
+            tree.remove(victim->first);
+            expected.erase(victim);
+        }
+        ok = ok && sameAsMap(tree, expected) && fewestItems<Tree>(tree.height()) <= tree.size();
+    }
+    ok = ok && tree.height() == 0 && sameBackwards(tree, expected);
+
+    vector<pair<int, int> > items;
+    for(int i = 0; i < 3000; ++i) {
+        items.push_back(std::make_pair(static_cast<int>(rng() % 4000), i));
+    }
+    expected.clear();
+    for(size_t i = 0; i < items.size(); ++i) {
+        expected[items[i].first] = items[i].second;
+    }
+    tree.bulkLoad(items.begin(), items.end());
+    ok = ok && sameAsMap(tree, expected) && sameBackwards(tree, expected);
+    ok = ok && fewestItems<Tree>(tree.height()) <= tree.size();
+    for(int i = 0; i < 3000; ++i) {
+        ok = randomUpdate(tree, expected, rng, 4000) && ok;
+    }
+    ok = ok && sameAsMap(tree, expected) && fewestItems<Tree>(tree.height()) <= tree.size();
+    ok = ok && tree[expected.begin()->first] == expected.begin()->second;
+    report(msg, ok);
+}
+
+// freeze() of trees of every size up to 70, where the Eytzinger layout's
+// last level fills and spills over, and of some larger ones: items both
+// ways round, find and lower_bound for keys in and between the tree's,
+// and a snapshot that later changes to the tree leave alone
+void testFreeze(const char* msg)
+{
+    mt19937 rng(7);
+    bool ok = true;
+    vector<int> sizes;
+    for(int n = 0; n <= 70; ++n) {
+        sizes.push_back(n);
+    }
+    sizes.push_back(255);
+    sizes.push_back(256);
+    sizes.push_back(1000);
+    for(size_t s = 0; s < sizes.size(); ++s) {
+        int n = sizes[s];
+        AVLTree<int, int> tree;
+        map<int, int> expected;
+        for(int i = 0; i < n; ++i) {
+            int key = static_cast<int>(rng() % (4 * n)) * 2;
+            tree.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+        FrozenMap<int, int> frozen = tree.freeze();
+        tree.insert(std::make_pair(1, -1));
+        ok = ok && sameAsMap(frozen, expected) && sameBackwards(frozen, expected);
+        for(int key = -1; key <= 8 * n + 1; ++key) {
+            map<int, int>::iterator e = expected.find(key);
+            FrozenMap<int, int>::iterator it = frozen.find(key);
+            ok = ok && (e == expected.end() ? it == frozen.end() : it != frozen.end() && it->second == e->second);
+            map<int, int>::iterator lower = expected.lower_bound(key);
+            ok = ok && keyAt(frozen, frozen.lower_bound(key), -1) == (lower == expected.end() ? -1 : lower->first);
+        }
+
+        vector<pair<int, int> > items(expected.begin(), expected.end());
+        FrozenMap<int, int> direct(items.begin(), items.end());
+        ok = ok && sameAsMap(direct, expected);
+    }
+    report(msg, ok);
+}
+
+// The signed lanes the search kernels compare Key as
+template<typename Key>
+struct LaneOf
+{
+    typedef typename conditional<sizeof(Key) == 4, int32_t, int64_t>::type type;
+};
+
+// Every search kernel the CPU has against std::lower_bound, on sorted
+// blocks of random keys (some runs of repeats) and on keys both in and
+// between them; unsigned keys exercise the sign-bit flip
+template<typename Key>
+bool kernelsAgree(mt19937_64& rng)
+{
+    typedef typename LaneOf<Key>::type Lane;
+    const Lane flip = is_signed<Key>::value ? Lane(0) : numeric_limits<Lane>::min();
+    Key block[FLAT_SEARCH_BLOCK];
+    bool ok = true;
+    for(int trial = 0; trial < 3000; ++trial) {
+        for(size_t i = 0; i < FLAT_SEARCH_BLOCK; ++i) {
+            block[i] = static_cast<Key>(trial % 3 == 0 ? rng() % 8 : rng());
+        }
+        sort(block, block + FLAT_SEARCH_BLOCK);
+        Key key = static_cast<Key>(rng());
+        if(trial % 2 == 0) key = static_cast<Key>(block[rng() % FLAT_SEARCH_BLOCK] + Key(trial % 4 == 0));
+        size_t expected = lower_bound(block, block + FLAT_SEARCH_BLOCK, key) - block;
+        Lane target = static_cast<Lane>(key);
+        ok = ok && flatCountLessScalar(block, target, flip) == expected;
+#ifdef FLAT_SORTED_MAP_X86
+        if(__builtin_cpu_supports("sse4.2")) ok = ok && flatCountLessSse(block, target, flip) == expected;
+        if(__builtin_cpu_supports("avx2")) ok = ok && flatCountLessAvx2(block, target, flip) == expected;
+#endif
+    }
+    return ok;
+}
+
+// A FlatSortedMap<Key, int> against a std::map through a bulk load, random
+// updates, lookups through a const map and removal down to empty, which
+// takes the search below one kernel block. Keys span the whole of Key and
+// are drawn from a pool so that some repeat
+template<typename Key>
+bool flatMatchesMap(mt19937_64& rng)
+{
+    static_assert(FlatSortedMap<Key, int>::VECTORIZED, "integer keys take the kernel search");
+    typedef FlatSortedMap<Key, int> Flat;
+    vector<Key> pool;
+    for(int i = 0; i < 3000; ++i) {
+        pool.push_back(static_cast<Key>(rng()));
+    }
+    vector<pair<Key, int> > items;
+    map<Key, int> expected;
+    for(int i = 0; i < 2000; ++i) {
+        items.push_back(make_pair(pool[rng() % pool.size()], i));
+        expected[items.back().first] = i;
+    }
+    Flat flat;
+    flat.bulkLoad(items.begin(), items.end());
+    bool ok = sameAsMap(flat, expected);
+
+    for(int i = 0; i < 2000; ++i) {
+        Key key = pool[rng() % pool.size()];
+        if(rng() % 5 < 3) {
+            flat.insert(make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            flat.remove(key);
+            expected.erase(key);
+        }
+    }
+    ok = ok && sameAsMap(flat, expected);
+
+    const Flat& readOnly = flat;
+    vector<Key> keys;
+    for(typename Flat::iterator it = flat.begin(); it != flat.end(); ++it) {
+        it->second += 1;
+        keys.push_back(it->first);
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    while(true) {
+        for(int i = 0; i < 20; ++i) {
+            Key key = (i % 2 == 0) ? pool[rng() % pool.size()] : static_cast<Key>(rng());
+            typename Flat::const_iterator it = readOnly.lower_bound(key);
+            typename map<Key, int>::const_iterator e = expected.lower_bound(key);
+            if(e == expected.end()) ok = ok && it == readOnly.end();
+            else ok = ok && it != readOnly.end() && it->first == e->first && it->second == e->second + 1;
+            ok = ok && (readOnly.find(key) == readOnly.end()) == (expected.count(key) == 0);
+        }
+        if(keys.empty()) break;
+        flat.remove(keys.back());
+        expected.erase(keys.back());
+        keys.pop_back();
+    }
+    return ok && flat.empty();
+}
+
+// The kernels, and maps using them, for each width and signedness of key
+void testFlatSortedMap(const char* msg)
+{
+    static_assert(is_same<FlatSortedMap<int, int>::const_iterator::value_reference, const int&>::value,
+                  "a const map hands out read-only values");
+    mt19937_64 rng(13);
+    bool ok = kernelsAgree<int>(rng) && kernelsAgree<unsigned>(rng)
+              && kernelsAgree<long long>(rng) && kernelsAgree<uint64_t>(rng);
+    ok = ok && flatMatchesMap<int>(rng) && flatMatchesMap<unsigned>(rng)
+         && flatMatchesMap<long long>(rng) && flatMatchesMap<uint64_t>(rng);
+    report(msg, ok);
+}
+
+// findBatch against find for batches of every size around the group of
+// searches it runs at once, half of whose keys are missing, on an empty
+// tree and on trees of a few sizes; out starts too long to check it is
+// resized
+template<typename Tree>
+bool batchMatchesFind(Tree& tree, mt19937& rng)
+{
+    const size_t sizes[] = {0, 1, 15, 16, 17, 33, 1000};
+    bool ok = true;
+    for(int round = 0; round < 4; ++round) {
+        for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+            vector<int> keys;
+            for(size_t i = 0; i < sizes[s]; ++i) {
+                keys.push_back(static_cast<int>(rng() % 4000));
+            }
+            vector<typename Tree::iterator> out(sizes[s] + 5);
+            tree.findBatch(keys, out);
+            ok = ok && out.size() == keys.size();
+            for(size_t i = 0; ok && i < keys.size(); ++i) {
+                ok = out[i] == tree.find(keys[i]);
+            }
+        }
+        for(int i = 0; i < 700; ++i) {
+            int key = static_cast<int>(rng() % 4000);
+            tree.insert(std::make_pair(key, key));
+        }
+    }
+    return ok;
+}
+
+void testFindBatch(const char* msg)
+{
+    mt19937 rng(14);
+    BinarySearchTree<int, int> bst;
+    AVLTree<int, int> avl;
+    report(msg, batchMatchesFind(bst, rng) && batchMatchesFind(avl, rng));
+}
+
+// One writer inserting, removing and now and then clearing keys whose
+// values are always three times the key, while readers check every value
+// they find, that range scans come back in order and inside their range,
+// and that sizes stay possible; then the tree against the std::map the
+// writer kept
+void testConcurrent(const char* msg)
+{
+    const int keyRange = 2000;
+    ConcurrentAVLTree<int, int> tree;
+    map<int, int> expected;
+    atomic<bool> done(false);
+    atomic<bool> readersOk(true);
+    vector<thread> readers;
+    for(int r = 0; r < 3; ++r) {
+        readers.push_back(thread([&tree, &done, &readersOk, r, keyRange]() {
+            mt19937 rng(100 + r);
+            while(!done.load()) {
+                int key = static_cast<int>(rng() % keyRange);
+                int value = 0;
+                if(tree.find(key, value) && value != 3 * key) readersOk = false;
+                int lo = static_cast<int>(rng() % keyRange);
+                int previous = lo - 1;
+                bool inOrder = true;
+                tree.forEachInRange(lo, lo + 100, [&](const std::pair<const int, int>& item) {
+                    if(item.first <= previous || item.first >= lo + 100 || item.second != 3 * item.first) inOrder = false;
+                    previous = item.first;
+                });
+                if(!inOrder || tree.size() > static_cast<size_t>(keyRange)) readersOk = false;
+            }
+        }));
+    }
+    mt19937 rng(15);
+    for(int i = 1; i <= 20000; ++i) {
+        int key = static_cast<int>(rng() % keyRange);
+        if(rng() % 5 < 3) {
+            tree.insert(std::make_pair(key, 3 * key));
+            expected[key] = 3 * key;
+        }
+        else {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        if(i % 7000 == 0) {
+            tree.clear();
+            expected.clear();
+        }
+    }
+    done = true;
+    for(size_t r = 0; r < readers.size(); ++r) {
+        readers[r].join();
+    }
+
+    map<int, int> seen;
+    tree.forEachInRange(0, keyRange, [&seen](const std::pair<const int, int>& item) { seen[item.first] = item.second; });
+    bool ok = readersOk && seen == expected && tree.size() == expected.size() && !tree.empty();
+    for(int key = 0; ok && key < keyRange; ++key) {
+        ok = tree.contains(key) == (expected.count(key) == 1);
+    }
+    tree.clear();
+    report(msg, ok && tree.empty() && tree.size() == 0);
+}
+
+// Reaches the nodes of a PersistentAVLTree to check its stored heights
+// and sizes, and its balance
+struct PersistentNodes : PersistentAVLTree<int, int>
+{
+    // The height of n's subtree, or -1 if anything under it is wrong
+    static int check(const Node* n)
+    {
+        if(n == nullptr) return 0;
+        int left = check(n->left);
+        int right = check(n->right);
+        if(left < 0 || right < 0 || abs(right - left) > 1) return -1;
+        if(n->height != 1 + max(left, right) || n->size != 1 + subtreeSize(n->left) + subtreeSize(n->right)) return -1;
+        return n->height;
+    }
+
+    static bool isAVL(const PersistentAVLTree<int, int>& tree)
+    {
+        return check(tree.*(&PersistentNodes::root_)) >= 0;
+    }
+};
+
+// Random updates against a std::map, taking a snapshot (and a copy of the
+// map) every so often; every snapshot must still hold what it held when it
+// was taken. Once the snapshots go only the tree's own nodes are left, and
+// once it goes too the node count is back where it started
+void testPersistent(const char* msg)
+{
+    typedef PersistentAVLTree<int, int> Tree;
+    const size_t baseline = Tree::liveNodes();
+    mt19937 rng(16);
+    bool ok = true;
+    {
+        Tree tree;
+        map<int, int> expected;
+        vector<Tree> snapshots;
+        vector<map<int, int> > snapshotItems;
+        for(int i = 1; i <= 4000; ++i) {
+            ok = randomUpdate(tree, expected, rng, 1500) && ok;
+            if(i % 250 == 0) {
+                snapshots.push_back(tree.snapshot());
+                snapshotItems.push_back(expected);
+                ok = ok && PersistentNodes::isAVL(tree) && sameAsMap(tree, expected);
+            }
+        }
+        Tree copied(snapshots[3]);
+        Tree moved(std::move(snapshots[4]));
+        snapshots[4] = moved;
+        ok = ok && sameAsMap(copied, snapshotItems[3]);
+        for(size_t i = 0; i < snapshots.size(); ++i) {
+            ok = ok && sameAsMap(snapshots[i], snapshotItems[i]) && PersistentNodes::isAVL(snapshots[i]);
+        }
+        snapshots.clear();
+        copied.clear();
+        moved.clear();
+        ok = ok && Tree::liveNodes() == baseline + tree.size();
+    }
+    report(msg, ok && Tree::liveNodes() == baseline);
+}
+
+// Inserts count random keys below keyRange, with random values, into both
+// tree and expected
+template<typename Tree>
+void fillRandom(Tree& tree, map<int, int>& expected, int count, int keyRange, mt19937& rng)
+{
+    for(int i = 0; i < count; ++i) {
+        int key = static_cast<int>(rng() % keyRange);
+        int value = static_cast<int>(rng() % 1000);
+        tree.insert(std::make_pair(key, value));
+        expected[key] = value;
+    }
+}
+
+// One set operation (0 union, 1 intersection, 2 difference) on random
+// trees of the given sizes, checked against the same operation on maps;
+// the argument must come back empty and both trees must still take updates
+bool setOperationMatches(int op, int aCount, int bCount, int keyRange, mt19937& rng)
+{
+    AVLTree<int, int> a, b;
+    map<int, int> expected, other;
+    fillRandom(a, expected, aCount, keyRange, rng);
+    fillRandom(b, other, bCount, keyRange, rng);
+    if(op == 0) {
+        a.unionWith(b);
+        for(map<int, int>::iterator it = other.begin(); it != other.end(); ++it) {
+            expected[it->first] = it->second;
+        }
+    }
+    else {
+        if(op == 1) a.intersect(b);
+        else a.difference(b);
+        for(map<int, int>::iterator it = expected.begin(); it != expected.end(); ) {
+            if((other.count(it->first) == 1) == (op == 1)) ++it;
+            else expected.erase(it++);
+        }
+    }
+    bool ok = sameAsMap(a, expected) && isAVL(a) && b.empty() && isAVL(b);
+    map<int, int> none;
+    fillRandom(a, expected, 50, keyRange, rng);
+    fillRandom(b, none, 50, keyRange, rng);
+    return ok && sameAsMap(a, expected) && sameAsMap(b, none);
+}
+
+// join and split against std::map at random pivots, on trees of very
+// different sizes, then every set operation at a spread of size ratios,
+// including an empty side and one big enough to fork
+void testJoinSplit(const char* msg)
+{
+    mt19937 rng(17);
+    bool ok = true;
+    const int counts[][2] = {{0, 0}, {0, 40}, {40, 0}, {1, 3000}, {3000, 1}, {500, 500}, {2000, 60}};
+    for(size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        int pivot = static_cast<int>(rng() % 10000);
+        AVLTree<int, int> less, greater;
+        map<int, int> expected, above;
+        for(int i = 0; i < counts[c][0]; ++i) {
+            int key = static_cast<int>(rng() % (pivot + 1));
+            less.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+        for(int i = 0; i < counts[c][1]; ++i) {
+            int key = pivot + 1 + static_cast<int>(rng() % 10000);
+            greater.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+        less.join(greater);
+        ok = ok && sameAsMap(less, expected) && isAVL(less) && greater.empty();
+
+        int at = static_cast<int>(rng() % 20000) - 100;
+        less.split(at, greater);
+        above.insert(expected.lower_bound(at), expected.end());
+        expected.erase(expected.lower_bound(at), expected.end());
+        ok = ok && sameAsMap(less, expected) && isAVL(less) && sameAsMap(greater, above) && isAVL(greater);
+
+        //the halves share pool memory; both must keep working
+        for(int i = 0; i < 30; ++i) {
+            int key = static_cast<int>(rng() % 20000);
+            (key < at ? less : greater).insert(std::make_pair(key, -i));
+            (key < at ? expected : above)[key] = -i;
+            key = static_cast<int>(rng() % 20000);
+            (key < at ? less : greater).remove(key);
+            (key < at ? expected : above).erase(key);
+        }
+        ok = ok && sameAsMap(less, expected) && sameAsMap(greater, above) && isAVL(less) && isAVL(greater);
+    }
+
+    const int sizes[][2] = {{0, 300}, {300, 0}, {1, 2000}, {2000, 1}, {200, 5000}, {3000, 3000}, {20000, 15000}};
+    for(int op = 0; op < 3; ++op) {
+        for(size_t c = 0; c < sizeof(sizes) / sizeof(sizes[0]); ++c) {
+            ok = setOperationMatches(op, sizes[c][0], sizes[c][1], 3 * max(sizes[c][0], sizes[c][1]) + 10, rng) && ok;
+        }
+    }
+
+    AVLTree<int, int> self;
+    map<int, int> expected;
+    fillRandom(self, expected, 100, 1000, rng);
+    self.join(self);
+    self.unionWith(self);
+    self.intersect(self);
+    ok = ok && sameAsMap(self, expected);
+    self.difference(self);
+    report(msg, ok && self.empty());
+}
+
+// parallelBulkLoad and the parallel range constructor against std::map,
+// on shuffled items with repeated keys, from empty up to sizes past
+// PARALLEL_GRAIN so that the sort and build fork wherever there are
+// workers; then parallelForEach must visit every item exactly once
+void testParallel(const char* msg)
+{
+    mt19937 rng(18);
+    bool ok = true;
+    const int sizes[] = {0, 1, 100, 5000, 40000};
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        const int n = sizes[s];
+        vector<pair<int, int> > items;
+        map<int, int> expected;
+        for(int i = 0; i < n; ++i) {
+            items.push_back(std::make_pair(static_cast<int>(rng() % (2 * n + 1)), i));
+            expected[items.back().first] = i;
+        }
+        int least = 0;
+        while((1u << least) <= expected.size()) ++least;
+
+        AVLTree<int, int> avl;
+        avl.insert(std::make_pair(-1, -1));
+        avl.parallelBulkLoad(items.begin(), items.end());
+        ok = ok && sameAsMap(avl, expected) && isAVL(avl) && heightOf(avl) == least;
+        BinarySearchTree<int, int> plain(ParallelTag(), items.begin(), items.end());
+        ok = ok && sameAsMap(plain, expected) && heightOf(plain) == least;
+        AVLTree<int, int> constructed(ParallelTag(), items.begin(), items.end());
+        ok = ok && sameAsMap(constructed, expected) && isAVL(constructed);
+
+        //through the base class, after which the tree's own updates must
+        //see the loaded items
+        AVLTree<int, int> viaBase;
+        BinarySearchTree<int, int>& base = viaBase;
+        base.insert(std::make_pair(-1, -1));
+        base.parallelBulkLoad(items.begin(), items.end());
+        map<int, int> copy = expected;
+        ok = ok && sameAsMap(viaBase, copy) && isAVL(viaBase);
+        for(int i = 0; i < 200; ++i) {
+            ok = randomUpdate(base, copy, rng, 2 * n + 1) && ok;
+        }
+        ok = ok && sameAsMap(viaBase, copy) && isAVL(viaBase);
+
+        //the pools adopted from the build must keep working
+        for(int i = 0; i < 200; ++i) {
+            ok = randomUpdate(avl, expected, rng, 2 * n + 1) && ok;
+        }
+        ok = ok && sameAsMap(avl, expected) && isAVL(avl);
+
+        mutex lock;
+        vector<pair<int, int> > seen;
+        avl.parallelForEach([&lock, &seen](const std::pair<const int, int>& item) {
+            lock_guard<mutex> guard(lock);
+            seen.push_back(item);
+        });
+        sort(seen.begin(), seen.end());
+        ok = ok && seen == vector<pair<int, int> >(expected.begin(), expected.end());
+    }
+    report(msg, ok);
+}
+
+// Random updates against a std::map on a tree that starts empty, checking
+// the items and the stored balances as it goes, then ascending inserts and
+// removal of every key in random order; used for the trees whose nodes
+// are hidden, which check their own balances
+template<typename Tree>
+bool updatesMatchMap(Tree& tree, mt19937& rng)
+{
+    map<int, int> expected;
+    bool ok = true;
+    for(int round = 0; round < 20; ++round) {
+        for(int i = 0; i < 500; ++i) {
+            ok = randomUpdate(tree, expected, rng, 2000) && ok;
+        }
+        ok = ok && sameAsMap(tree, expected) && tree.isBalanced();
+    }
+    for(int key = 2000; key < 6000; ++key) {
+        tree.insert(std::make_pair(key, key));
+        expected[key] = key;
+    }
+    ok = ok && sameAsMap(tree, expected) && tree.isBalanced() && tree[4321] == 4321;
+    vector<int> keys;
+    for(map<int, int>::iterator it = expected.begin(); it != expected.end(); ++it) {
+        keys.push_back(it->first);
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.remove(keys[i]);
+        expected.erase(keys[i]);
+        if(i % 200 == 0) ok = ok && sameAsMap(tree, expected) && tree.isBalanced();
+    }
+    return ok && tree.empty() && tree.begin() == tree.end();
+}
+
+void testStackAVL(const char* msg)
+{
+    mt19937 rng(19);
+    StackAVLTree<int, int> tree;
+    bool ok = updatesMatchMap(tree, rng);
+    ok = updatesMatchMap(tree, rng) && ok;
+    tree.insert(std::make_pair(1, 1));
+    tree.clear();
+    report(msg, ok && tree.empty() && tree.size() == 0);
+}
+
+// As for StackAVLTree; the removals also check that moving the array's
+// last node into each freed slot keeps every item reachable
+void testCompactAVL(const char* msg)
+{
+    mt19937 rng(20);
+    CompactAVLTree<int, int> tree;
+    bool ok = updatesMatchMap(tree, rng);
+    tree.reserve(1000);
+    ok = updatesMatchMap(tree, rng) && ok;
+    tree.insert(std::make_pair(1, 1));
+    tree.clear();
+    report(msg, ok && tree.empty() && tree.size() == 0);
+}
+
+// The counters from tree_stats.h. Without BST_STATS they must all stay
+// zero however the tree is used. With it, the search counters must match a
+// replay of internalFind's descent exactly, and updates must have counted
+// rotations and retracing steps. Each tree counts only its own work, which
+// any thread can read, whichever thread did it
+void testStats(const char* msg)
+{
+    typedef AVLTree<int, int> Tree;
+    mt19937 rng(21);
+    Tree tree;
+    tree.resetStats();
+    for(int key = 0; key < 1000; ++key) {
+        tree.insert(std::make_pair(key, key));
+    }
+    for(int i = 0; i < 300; ++i) {
+        tree.remove(static_cast<int>(rng() % 1000));
+    }
+    for(Tree::iterator it = tree.begin(); it != tree.end(); ++it) { }
+    TreeStats updates = tree.stats();
+
+    tree.resetStats();
+    unsigned long long comparisons = 0;
+    vector<unsigned long long> histogram(TreeStats::MAX_DEPTH);
+    for(int i = 0; i < 500; ++i) {
+        int key = static_cast<int>(rng() % 1200);
+        tree.find(key);
+        int depth = 0;
+        bool candidate = false;
+        for(Node<int, int>* n = TreeRoot<int, int>::of(tree); n != nullptr; ++depth) {
+            candidate = candidate || n->getKey() >= key;
+            n = (n->getKey() < key) ? n->getRight() : n->getLeft();
+        }
+        comparisons += depth + candidate;
+        ++histogram[min(depth, TreeStats::MAX_DEPTH - 1)];
+    }
+    //read from a thread that did none of the work
+    TreeStats searches;
+    thread monitor([&tree, &searches]() { searches = tree.stats(); });
+    monitor.join();
+
+    //a second tree of the same type, filled on another thread
+    Tree other;
+    thread writer([&other]() {
+        for(int key = 0; key < 1000; ++key) {
+            other.insert(std::make_pair(key, key));
+        }
+        other.find(500);
+    });
+    writer.join();
+    TreeStats otherStats = other.stats();
+    TreeStats after = tree.stats();
+
+    bool ok;
+    if(TreeStats::ENABLED) {
+        ok = updates.rotations > 0 && updates.insertFixSteps >= 1000 && updates.removeFixSteps > 0
+             && updates.successorClimbs > 0 && searches.searches() == 500 && searches.comparisons == comparisons
+             && equal(histogram.begin(), histogram.end(), searches.depthHistogram)
+             && otherStats.rotations > 0 && otherStats.insertFixSteps >= 1000 && otherStats.searches() == 1
+             && memcmp(&after, &searches, sizeof(after)) == 0;
+    }
+    else {
+        TreeStats zero;
+        ok = memcmp(&updates, &zero, sizeof(zero)) == 0 && memcmp(&searches, &zero, sizeof(zero)) == 0
+             && memcmp(&otherStats, &zero, sizeof(zero)) == 0;
+    }
+    tree.resetStats();
+    ok = ok && tree.stats().searches() == 0 && tree.stats().rotations == 0;
+    report(msg, ok && other.stats().rotations == otherStats.rotations);
+}
+
+// The number of nodes on the path from the root of tree to key's node, or
+// 0 if key is missing
+template<typename Key, typename Value, typename Compare>
+int depthOf(const BinarySearchTree<Key, Value, Compare>& tree, const Key& key)
+{
+    int depth = 1;
+    for(Node<Key, Value>* n = TreeRoot<Key, Value, Compare>::of(tree); n != nullptr; ++depth) {
+        if(n->getKey() == key) return depth;
+        n = (n->getKey() < key) ? n->getRight() : n->getLeft();
+    }
+    return 0;
+}
+
+// Random updates and splaying finds against a std::map in one mode, with
+// links and sizes checked as the rotations go. Each found key must then be
+// at the root (FULL_SPLAY) or at no more than about half its old depth
+// (SEMI_SPLAY); a const find must leave the tree as it was; and a small hot
+// set of keys must end up near the root
+bool splayMatchesMap(SplayMode mode, mt19937& rng)
+{
+    SplayTree<int, int> tree(mode);
+    map<int, int> expected;
+    bool ok = tree.mode() == mode;
+    for(int key = 0; key < 500; ++key) {
+        tree.insert(std::make_pair(key, key));
+        expected[key] = key;
+    }
+    for(int round = 0; round < 10; ++round) {
+        for(int i = 0; i < 400; ++i) {
+            ok = randomUpdate(tree, expected, rng, 1500) && ok;
+        }
+        ok = ok && sameAsMap(tree, expected) && heightOf(tree) >= 0;
+
+        for(int i = 0; i < 50 && !expected.empty(); ++i) {
+            map<int, int>::iterator e = expected.begin();
+            advance(e, rng() % expected.size());
+            int before = depthOf(tree, e->first);
+            const SplayTree<int, int>& readOnly = tree;
+            ok = ok && readOnly.find(e->first)->second == e->second && depthOf(tree, e->first) == before;
+            ok = ok && tree.find(e->first)->second == e->second;
+            int after = depthOf(tree, e->first);
+            ok = ok && (mode == FULL_SPLAY ? after == 1 : after <= before / 2 + 2);
+        }
+        ok = ok && heightOf(tree) >= 0;
+    }
+    for(int key = 0; key < 800; key += 100) {
+        tree.insert(std::make_pair(key, key));
+        expected[key] = key;
+    }
+    for(int i = 0; i < 2000; ++i) {
+        tree.find(static_cast<int>(rng() % 8) * 100);
+    }
+    int hotDepth = 0;
+    for(int key = 0; key < 800; key += 100) {
+        hotDepth = max(hotDepth, depthOf(tree, key));
+    }
+    return ok && hotDepth <= 16 && sameAsMap(tree, expected) && heightOf(tree) >= 0;
+}
+
+void testSplay(const char* msg)
+{
+    mt19937 rng(22);
+    bool ok = splayMatchesMap(FULL_SPLAY, rng);
+    report(msg, splayMatchesMap(SEMI_SPLAY, rng) && ok);
+}
+
+// The number of black nodes on every path down from n, or -1 if the paths
+// disagree or a red node has a red child
+template<typename Key, typename Value>
+int blackHeight(const RBNode<Key, Value>* n)
+{
+    if(n == nullptr) return 0;
+    int left = blackHeight(n->getLeft());
+    int right = blackHeight(n->getRight());
+    if(left < 0 || left != right) return -1;
+    if(n->isRed() && ((n->getLeft() != nullptr && n->getLeft()->isRed())
+                      || (n->getRight() != nullptr && n->getRight()->isRed()))) return -1;
+    return left + (n->isRed() ? 0 : 1);
+}
+
+// Links, sizes, colours and black heights, a black root, and the height
+// within 2 log2(n + 1)
+template<typename Key, typename Value, typename Compare>
+bool isRedBlack(const RedBlackTree<Key, Value, Compare>& tree)
+{
+    const RBNode<Key, Value>* root = static_cast<const RBNode<Key, Value>*>(TreeRoot<Key, Value, Compare>::of(tree));
+    int height = heightOf(tree);
+    if(height < 0 || blackHeight(root) < 0 || (root != nullptr && root->isRed())) return false;
+    return (1u << (height / 2)) <= tree.size() + 1;
+}
+
+// Random updates against a std::map with the red black rules checked as
+// it goes, then bulk loads of several sizes, whose colouring must hold up
+// under further updates, and new keys through the emplace family, directly
+// and through a BinarySearchTree reference, which must make RBNodes
+void testRedBlack(const char* msg)
+{
+    mt19937 rng(23);
+    RedBlackTree<int, int> tree;
+    map<int, int> expected;
+    bool ok = true;
+    for(int round = 0; round < 20; ++round) {
+        for(int i = 0; i < 500; ++i) {
+            ok = randomUpdate(tree, expected, rng, 2000) && ok;
+        }
+        ok = ok && sameAsMap(tree, expected) && isRedBlack(tree);
+    }
+
+    for(int n = 0; n <= 3000; n = n * 3 + 1) {
+        vector<pair<int, int> > items;
+        expected.clear();
+        for(int i = 0; i < n; ++i) {
+            items.push_back(std::make_pair(static_cast<int>(rng() % (2 * n + 1)), i));
+            expected[items.back().first] = i;
+        }
+        RedBlackTree<int, int> loaded(items.begin(), items.end());
+        RedBlackTree<int, int> parallel(ParallelTag(), items.begin(), items.end());
+        ok = ok && sameAsMap(loaded, expected) && isRedBlack(loaded)
+             && sameAsMap(parallel, expected) && isRedBlack(parallel);
+        map<int, int> copy = expected;
+        for(int i = 0; i < 300; ++i) {
+            ok = randomUpdate(loaded, expected, rng, 2 * n + 2) && ok;
+            ok = randomUpdate(parallel, copy, rng, 2 * n + 2) && ok;
+        }
+        ok = ok && sameAsMap(loaded, expected) && isRedBlack(loaded)
+             && sameAsMap(parallel, copy) && isRedBlack(parallel);
+    }
+
+    expected.clear();
+    tree.clear();
+    for(int i = 0; i < 600; ++i) {
+        int key = static_cast<int>(rng() % 400);
+        switch(i % 3) {
+        case 0:
+            tree.emplace(key, i);
+            expected.insert(std::make_pair(key, i));
+            break;
+        case 1:
+            tree.try_emplace(key, i);
+            expected.insert(std::make_pair(key, i));
+            break;
+        default:
+            tree.insert_or_assign(key, i);
+            expected[key] = i;
+        }
+    }
+    ok = ok && sameAsMap(tree, expected) && isRedBlack(tree);
+
+    //and through a base reference, which must make RBNodes too
+    RedBlackTree<int, int> viaBase;
+    BinarySearchTree<int, int>& base = viaBase;
+    map<int, int> expectedBase;
+    for(int i = 0; i < 3000; ++i) {
+        ok = randomEmplace(base, expectedBase, rng, 1000) && ok;
+    }
+    report(msg, ok && sameAsMap(viaBase, expectedBase) && isRedBlack(viaBase));
+}
+
+// Reaches ScapegoatTree's depth limit, floor(log base 1/alpha of n)
+struct ScapegoatLimit : ScapegoatTree<int, int>
+{
+    static int of(size_t n)
+    {
+        return depthLimit(n);
+    }
+};
+
+// Appends the keys under n in pre-order, which pins down the tree's shape
+template<typename Key, typename Value>
+void preorder(const Node<Key, Value>* n, vector<Key>& keys)
+{
+    if(n == nullptr) return;
+    keys.push_back(n->getKey());
+    preorder(n->getLeft(), keys);
+    preorder(n->getRight(), keys);
+}
+
+// After emptying, by clear() or by loading nothing, a small tree built in
+// a lopsided order must lose a leaf without being rebuilt from the root, as
+// it would be if the size before emptying were still counted
+bool scapegoatForgetsSize(bool byClear)
+{
+    ScapegoatTree<int, int> tree;
+    for(int key = 0; key < 1000; ++key) {
+        tree.insert(std::make_pair(key, key));
+    }
+    vector<pair<int, int> > none;
+    if(byClear) tree.clear();
+    else tree.bulkLoad(none.begin(), none.end());
+    const int order[] = {3, 1, 2, 5, 4, 6};
+    for(int i = 0; i < 6; ++i) {
+        tree.insert(std::make_pair(order[i], i));
+    }
+    tree.remove(6);
+    vector<int> shape;
+    preorder(TreeRoot<int, int>::of(tree), shape);
+    const int expected[] = {3, 1, 2, 5, 4};
+    return shape == vector<int>(expected, expected + 5);
+}
+
+// Random updates against a std::map, sorted runs and mass removals, with
+// the height held to the depth limit of the largest size the tree can have
+// had since its last full rebuild, which is under size / alpha
+void testScapegoat(const char* msg)
+{
+    mt19937 rng(24);
+    ScapegoatTree<int, int> tree;
+    map<int, int> expected;
+    bool ok = true;
+    for(int round = 0; round < 30; ++round) {
+        if(round % 10 == 5) {
+            for(int key = 0; key < 3000; ++key) {
+                tree.insert(std::make_pair(key, key));
+                expected[key] = key;
+            }
+        }
+        if(round % 10 == 8) {
+            for(int key = 0; key < 3000; key += 1 + key % 4 % 3) {
+                tree.remove(key);
+                expected.erase(key);
+            }
+        }
+        for(int i = 0; i < 500; ++i) {
+            ok = randomUpdate(tree, expected, rng, 4000) && ok;
+        }
+        int height = heightOf(tree);
+        ok = ok && sameAsMap(tree, expected) && height >= 0
+             && (tree.empty() || height <= ScapegoatLimit::of(tree.size()) + 2);
+    }
+    vector<pair<int, int> > items(expected.begin(), expected.end());
+    ScapegoatTree<int, int> loaded(items.begin(), items.end());
+    ok = ok && sameAsMap(loaded, expected) && heightOf(loaded) >= 0;
+    report(msg, ok && scapegoatForgetsSize(true) && scapegoatForgetsSize(false));
+}
+
+// Picks the hint for the next hinted call: the previous result, end(), or
+// a random position
+BinarySearchTree<int, int>::iterator nextHint(const BinarySearchTree<int, int>& tree,
+                                              BinarySearchTree<int, int>::iterator previous, mt19937& rng)
+{
+    switch(rng() % 3) {
+    case 0:
+        return previous;
+    case 1:
+        return tree.end();
+    default:
+        return tree.select(rng() % (tree.size() + 1));
+    }
+}
+
+// Inserts of sorted, nearly sorted and random keys, each followed by a
+// hinted find of the key, then hinted finds of every key in range, a few of the emplace family, and a bulkLoad
+// followed by random updates, all through a BinarySearchTree reference so
+// derived trees must still make their own nodes and track their own root,
+// checked against a std::map
+bool hintsMatchMap(BinarySearchTree<int, int>& tree, mt19937& rng)
+{
+    typedef BinarySearchTree<int, int>::iterator iterator;
+    map<int, int> expected;
+    bool ok = true;
+    for(int order = 0; order < 3; ++order) {
+        vector<int> keys;
+        for(int i = 0; i < 1500; ++i) {
+            keys.push_back(order == 2 ? static_cast<int>(rng() % 4000) : 2 * i + order);
+        }
+        if(order == 1) {
+            for(size_t i = 0; i < keys.size(); ++i) {
+                swap(keys[i], keys[min(keys.size() - 1, i + rng() % 17)]);
+            }
+        }
+        iterator hint = tree.end();
+        for(size_t i = 0; i < keys.size(); ++i) {
+            int value = static_cast<int>(rng() % 1000);
+            tree.insert_or_assign(keys[i], value);
+            expected[keys[i]] = value;
+            hint = tree.find(nextHint(tree, hint, rng), keys[i]);
+            ok = ok && hint != tree.end() && hint->first == keys[i] && hint->second == value;
+        }
+    }
+
+    iterator hint = tree.end();
+    for(int key = -1; key <= 4000; ++key) {
+        iterator it = tree.find(nextHint(tree, hint, rng), key);
+        map<int, int>::iterator e = expected.find(key);
+        if(e == expected.end()) {
+            ok = ok && it == tree.end();
+        }
+        else {
+            ok = ok && it != tree.end() && it->first == key && it->second == e->second;
+            hint = it;
+        }
+    }
+
+    for(int i = 0; i < 300; ++i) {
+        int key = static_cast<int>(rng() % 5000);
+        switch(i % 3) {
+        case 0:
+            tree.emplace(key, i);
+            expected.insert(std::make_pair(key, i));
+            break;
+        case 1:
+            tree.try_emplace(key, i);
+            expected.insert(std::make_pair(key, i));
+            break;
+        default:
+            tree.insert_or_assign(key, i);
+            expected[key] = i;
+        }
+    }
+    ok = ok && sameAsMap(tree, expected);
+
+    //a load through the base class must leave the tree's own inserts and
+    //removes working on the new items
+    vector<pair<int, int> > items;
+    expected.clear();
+    for(int i = 0; i < 2000; ++i) {
+        items.push_back(std::make_pair(static_cast<int>(rng() % 4000), i));
+        expected[items.back().first] = i;
+    }
+    tree.bulkLoad(items.begin(), items.end());
+    ok = ok && sameAsMap(tree, expected);
+    for(int i = 0; i < 1000; ++i) {
+        ok = randomUpdate(tree, expected, rng, 4000) && ok;
+    }
+    return ok && sameAsMap(tree, expected);
+}
+
+// Hinted finds on every tree built on BinarySearchTree, whose invariants
+// must survive nodes made through the base class, and through each derived
+// tree's own scope, where the hinted find must not be hidden
+void testHints(const char* msg)
+{
+    mt19937 rng(25);
+    BinarySearchTree<int, int> plain;
+    AVLTree<int, int> avl;
+    RedBlackTree<int, int> redBlack;
+    SplayTree<int, int> splay;
+    ScapegoatTree<int, int> scapegoat;
+    bool ok = hintsMatchMap(plain, rng) && heightOf(plain) >= 0;
+    ok = hintsMatchMap(avl, rng) && isAVL(avl) && ok;
+    ok = hintsMatchMap(redBlack, rng) && isRedBlack(redBlack) && ok;
+    ok = hintsMatchMap(splay, rng) && heightOf(splay) >= 0 && ok;
+    ok = hintsMatchMap(scapegoat, rng) && heightOf(scapegoat) >= 0
+         && heightOf(scapegoat) <= ScapegoatLimit::of(scapegoat.size()) + 2 && ok;
+
+    AVLTree<int, int> avlDirect;
+    RedBlackTree<int, int> redBlackDirect;
+    SplayTree<int, int> splayDirect;
+    AVLTree<int, int>::iterator a = avlDirect.end();
+    RedBlackTree<int, int>::iterator r = redBlackDirect.end();
+    SplayTree<int, int>::iterator s = splayDirect.end();
+    for(int key = 0; key < 200; ++key) {
+        avlDirect.insert(std::make_pair(key, key));
+        redBlackDirect.insert(std::make_pair(key, key));
+        splayDirect.insert(std::make_pair(key, key));
+        a = avlDirect.find(a, key);
+        r = redBlackDirect.find(r, key);
+        s = splayDirect.find(s, key);
+        ok = ok && a->first == key && r->first == key && s->first == key;
+    }
+    report(msg, ok && isAVL(avlDirect) && isRedBlack(redBlackDirect) && splayDirect.size() == 200);
+}
+
+// select(k) for every k and rank of every key in and just outside the
+// range, against the k-th key of expected and the count of keys below
+template<typename Tree>
+bool orderMatchesMap(const Tree& tree, const map<int, int>& expected, int keyRange)
+{
+    size_t k = 0;
+    for(map<int, int>::const_iterator e = expected.begin(); e != expected.end(); ++e, ++k) {
+        typename Tree::iterator it = tree.select(k);
+        if(it == tree.end() || it->first != e->first || it->second != e->second) return false;
+    }
+    if(tree.select(tree.size()) != tree.end() || tree.select(tree.size() + 5) != tree.end()) return false;
+    for(int key = -2; key <= keyRange + 1; ++key) {
+        size_t below = static_cast<size_t>(distance(expected.begin(), expected.lower_bound(key)));
+        if(tree.rank(key) != below) return false;
+    }
+    return true;
+}
+
+// Random inserts and removes against a std::map, checking select and rank
+// as the tree grows and shrinks, down to empty
+template<typename Tree>
+bool orderStatisticsMatch(mt19937& rng)
+{
+    Tree tree;
+    map<int, int> expected;
+    bool ok = orderMatchesMap(tree, expected, 10);
+    for(int round = 0; round < 20; ++round) {
+        for(int i = 0; i < 100; ++i) {
+            ok = randomUpdate(tree, expected, rng, 500) && ok;
+        }
+        ok = ok && sameAsMap(tree, expected) && orderMatchesMap(tree, expected, 500);
+    }
+    while(!expected.empty()) {
+        map<int, int>::iterator e = expected.begin();
+        advance(e, rng() % expected.size());
+        tree.remove(e->first);
+        expected.erase(e);
+        if(expected.size() % 25 == 0) ok = ok && orderMatchesMap(tree, expected, 500);
+    }
+    return ok && tree.empty() && orderMatchesMap(tree, expected, 500);
+}
+
+void testOrderStatistics(const char* msg)
+{
+    mt19937 rng(9);
+    bool ok = orderStatisticsMatch<BinarySearchTree<int, int> >(rng);
+    report(msg, orderStatisticsMatch<AVLTree<int, int> >(rng) && ok);
+}
+
+// Counts its calls, to check searches compare once per level
+struct CountingLess
+{
+    static long calls;
+    bool operator()(int a, int b) const
+    {
+        ++calls;
+        return a < b;
+    }
+};
+long CountingLess::calls = 0;
+
+// Lets a std::string keyed tree be searched with a const char*
+struct StringLess
+{
+    typedef void is_transparent;
+    bool operator()(const string& a, const string& b) const { return a < b; }
+    bool operator()(const string& a, const char* b) const { return a.compare(b) < 0; }
+    bool operator()(const char* a, const string& b) const { return b.compare(a) > 0; }
+};
+
+// Trees ordered by a comparator other than std::less: reversed order under
+// random updates, at most one comparison per level and one more to settle
+// equality, and a transparent comparator's heterogeneous find
+void testComparators(const char* msg)
+{
+    mt19937 rng(3);
+    bool ok = true;
+    AVLTree<int, int, greater<int> > reversed;
+    map<int, int, greater<int> > expected;
+    for(int i = 0; i < 3000; ++i) {
+        ok = randomUpdate(reversed, expected, rng, 1000) && ok;
+    }
+    ok = ok && sameAsMap(reversed, expected) && isAVL(reversed);
+
+    AVLTree<int, int, CountingLess> counted;
+    for(int i = 0; i < 1000; ++i) {
+        counted.insert(std::make_pair(static_cast<int>(rng() % 5000), i));
+    }
+    int height = heightOf(counted);
+    for(int key = 0; key < 5000; ++key) {
+        CountingLess::calls = 0;
+        counted.find(key);
+        ok = ok && CountingLess::calls <= height + 1;
+    }
+
+    BinarySearchTree<string, int, StringLess> names;
+    const char* words[] = {"pear", "apple", "fig", "plum", "kiwi"};
+    for(int i = 0; i < 5; ++i) {
+        names.insert(std::make_pair(string(words[i]), i));
+    }
+    for(int i = 0; i < 5; ++i) {
+        BinarySearchTree<string, int, StringLess>::iterator it = names.find(words[i]);
+        ok = ok && it != names.end() && it->second == i;
+    }
+    ok = ok && names.find("grape") == names.end() && names.begin()->first == "apple";
+    report(msg, ok);
+}
+
 
 int main(int argc, char *argv[])
 {
@@ -25,6 +1623,11 @@ int main(int argc, char *argv[])
     }
     cout << "Erasing b" << endl;
     bt.remove('b');
+    cout << "Overwriting a" << endl;
+    bt.insert(std::make_pair('a',3));
+    cout << "a " << bt['a'] << endl;
+    bt.clear();
+    cout << "Empty after clear: " << bt.empty() << endl;
 
     // AVL Tree Tests
     AVLTree<char,int> at;
@@ -41,8 +1644,36 @@ int main(int argc, char *argv[])
     else {
         cout << "Did not find b" << endl;
     }
+    cout << "Size " << at.size() << ", smallest " << at.select(0)->first
+         << ", rank of b " << at.rank('b') << endl;
+    FrozenMap<char,int> frozen = at.freeze();
+    cout << "Frozen b " << frozen['b'] << endl;
     cout << "Erasing b" << endl;
     at.remove('b');
 
-    return 0;
+    cout << "\nRandomized tests:" << endl;
+    testAVLUpdates("AVL updates");
+    testBulkLoad("Bulk load");
+    testComparators("Comparators");
+    testEmplace("Emplace");
+    testBounds("Bounds and ranges");
+    testBTree("BTreeMap");
+    testFreeze("Freeze");
+    testFlatSortedMap("FlatSortedMap");
+    testFindBatch("findBatch");
+    testConcurrent("ConcurrentAVLTree");
+    testPersistent("PersistentAVLTree");
+    testJoinSplit("Join, split and set operations");
+    testParallel("Parallel bulk load and forEach");
+    testParallelChain("parallelForEach on a chain");
+    testStackAVL("StackAVLTree");
+    testCompactAVL("CompactAVLTree");
+    testStats("Tree stats");
+    testSplay("SplayTree");
+    testRedBlack("RedBlackTree");
+    testScapegoat("ScapegoatTree");
+    testHints("Hinted find");
+    testOrderStatistics("select and rank");
+
+    return failures == 0 ? 0 : 1;
 }
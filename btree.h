@@ -0,0 +1,925 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "node_pool.h"
+
+/**
+* A map with the same insert/remove/find/operator[]/iterator interface as
+* BinarySearchTree, stored as a B+ tree. Each node holds many keys in a
+* contiguous array and is aligned to a cache line, so a lookup touches a
+* handful of nodes instead of one node per comparison.
+*
+* All items live in the leaves, which are linked together for iteration;
+* internal nodes only hold separator keys. Keys and values are kept in
+* separate arrays so the search within a node only reads keys, which means
+* iterators hand out a small proxy (with .first and .second) rather than a
+* reference to a std::pair.
+*
+* Key and Value must be default constructible and move assignable.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class BTreeMap
+{
+public:
+    static const std::size_t CACHE_LINE = 64;
+    // Nodes are sized to span a few cache lines.
+    static const std::size_t NODE_BYTES = 4 * CACHE_LINE;
+    static const int LEAF_SLOTS =
+            (NODE_BYTES - 4 * sizeof(void*)) / (sizeof(Key) + sizeof(Value)) > 4
+            ? (NODE_BYTES - 4 * sizeof(void*)) / (sizeof(Key) + sizeof(Value))
+            : 4;
+    static const int INNER_SLOTS =
+            (NODE_BYTES - 3 * sizeof(void*)) / (sizeof(Key) + sizeof(void*)) > 4
+            ? (NODE_BYTES - 3 * sizeof(void*)) / (sizeof(Key) + sizeof(void*))
+            : 4;
+
+    BTreeMap();
+    explicit BTreeMap(const Compare& comp);
+    ~BTreeMap();
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void insert(std::pair<const Key, Value>&& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    template<typename InputIterator>
+    void bulkLoad(InputIterator first, InputIterator last);
+    bool empty() const;
+    std::size_t size() const;
+    int height() const;
+
+private:
+    struct Leaf;
+
+public:
+    /**
+    * An iterator over the items in key order. Dereferencing gives a
+    * reference proxy whose first and second refer into the leaf.
+    */
+    class iterator
+    {
+    public:
+        struct reference
+        {
+            const Key& first;
+            Value& second;
+        };
+        struct pointer
+        {
+            reference ref;
+            reference* operator->() { return &ref; }
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator& operator--();
+
+    private:
+        friend class BTreeMap<Key, Value, Compare>;
+        iterator(Leaf* leaf, int index);
+        Leaf* leaf_;
+        int index_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    // Not copyable, like the other trees.
+    BTreeMap(const BTreeMap& other);
+    BTreeMap& operator=(const BTreeMap& other);
+
+    // Only the header; the alignment goes on Leaf and Inner so that it
+    // does not pad these 8 bytes out to a whole cache line.
+    struct NodeBase
+    {
+        bool leaf;
+        int count;
+    };
+
+    struct alignas(CACHE_LINE) Leaf : NodeBase
+    {
+        Leaf* prev;
+        Leaf* next;
+        Key keys[LEAF_SLOTS];
+        Value values[LEAF_SLOTS];
+    };
+
+    // children[i] holds the keys below keys[i]; children[i + 1] those at or above it
+    struct alignas(CACHE_LINE) Inner : NodeBase
+    {
+        Key keys[INNER_SLOTS];
+        NodeBase* children[INNER_SLOTS + 1];
+    };
+
+    // Keys too big for 4 slots to fit fall back to the minimum fan-out.
+    static_assert(sizeof(Leaf) <= NODE_BYTES || LEAF_SLOTS == 4,
+            "BTreeMap leaf is larger than NODE_BYTES");
+    static_assert(sizeof(Inner) <= NODE_BYTES || INNER_SLOTS == 4,
+            "BTreeMap inner node is larger than NODE_BYTES");
+
+    // Where a descent went at one inner node
+    struct PathEntry
+    {
+        Inner* node;
+        int index;
+    };
+
+    // Minimum fan-out is 2, so no tree indexable by std::size_t is deeper.
+    static const int MAX_HEIGHT = 64;
+
+    Leaf* newLeaf();
+    Inner* newInner();
+    void deleteLeaf(Leaf* leaf);
+    void deleteInner(Inner* inner);
+    void destroySubtree(NodeBase* n);
+
+    int upperIndex(const Inner* inner, const Key& key) const;
+    int lowerIndex(const Leaf* leaf, const Key& key) const;
+    Leaf* findLeaf(const Key& key, PathEntry* path, int& depth) const;
+    template<typename V>
+    void assignOrInsert(const Key& key, V&& value);
+    void insertIntoParent(PathEntry* path, int depth, Key separator, NodeBase* child);
+    void fixLeafUnderflow(Leaf* leaf, PathEntry* path, int depth);
+    void fixInnerUnderflow(Inner* inner, PathEntry* path, int depth);
+
+    NodeBase* root_;
+    std::size_t size_;
+    int height_;
+    Compare comp_;
+    NodePool leafPool_;
+    NodePool innerPool_;
+};
+
+/*
+----------------------------------------------------
+Begin implementations for the BTreeMap::iterator class.
+----------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<class Key, class Value, typename Compare>
+BTreeMap<Key, Value, Compare>::iterator::iterator() :
+    leaf_(nullptr), index_(0)
+{
+
+}
+
+/**
+* Explicit constructor for a position inside a leaf.
+*/
+template<class Key, class Value, typename Compare>
+BTreeMap<Key, Value, Compare>::iterator::iterator(Leaf* leaf, int index) :
+    leaf_(leaf), index_(index)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, typename Compare>
+typename BTreeMap<Key, Value, Compare>::iterator::reference
+BTreeMap<Key, Value, Compare>::iterator::operator*() const
+{
+    reference ref = {leaf_->keys[index_], leaf_->values[index_]};
+    return ref;
+}
+
+/**
+* Provides member access to the item, e.g. it->second.
+*/
+template<class Key, class Value, typename Compare>
+typename BTreeMap<Key, Value, Compare>::iterator::pointer
+BTreeMap<Key, Value, Compare>::iterator::operator->() const
+{
+    pointer ptr = {**this};
+    return ptr;
+}
+
+template<class Key, class Value, typename Compare>
+bool BTreeMap<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<class Key, class Value, typename Compare>
+bool BTreeMap<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances to the next item, moving on to the next leaf at the end of one.
+*/
+template<class Key, class Value, typename Compare>
+typename BTreeMap<Key, Value, Compare>::iterator&
+BTreeMap<Key, Value, Compare>::iterator::operator++()
+{
+    ++index_;
+    if(index_ == leaf_->count)
+    {
+        leaf_ = leaf_->next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+/**
+* Steps back to the previous item; stepping back from the first item
+* gives the end iterator.
+*/
+template<class Key, class Value, typename Compare>
+typename BTreeMap<Key, Value, Compare>::iterator&
+BTreeMap<Key, Value, Compare>::iterator::operator--()
+{
+    if(index_ > 0)
+    {
+        --index_;
+        return *this;
+    }
+    leaf_ = leaf_->prev;
+    index_ = (leaf_ == nullptr) ? 0 : leaf_->count - 1;
+    return *this;
+}
+
+/*
+--------------------------------------------------
+End implementations for the BTreeMap::iterator class.
+--------------------------------------------------
+*/
+
+/*
+-------------------------------------------
+Begin implementations for the BTreeMap class.
+-------------------------------------------
+*/
+
+template<class Key, class Value, typename Compare>
+BTreeMap<Key, Value, Compare>::BTreeMap() :
+    root_(nullptr),
+    size_(0),
+    height_(0),
+    comp_(),
+    leafPool_(sizeof(Leaf), CACHE_LINE),
+    innerPool_(sizeof(Inner), CACHE_LINE)
+{
+
+}
+
+/**
+* Constructor for an empty map ordered by the given comparator.
+*/
+template<class Key, class Value, typename Compare>
+BTreeMap<Key, Value, Compare>::BTreeMap(const Compare& comp) :
+    root_(nullptr),
+    size_(0),
+    height_(0),
+    comp_(comp),
+    leafPool_(sizeof(Leaf), CACHE_LINE),
+    innerPool_(sizeof(Inner), CACHE_LINE)
+{
+
+}
+
+template<class Key, class Value, typename Compare>
+BTreeMap<Key, Value, Compare>::~BTreeMap()
+{
+    clear();
+}
+
+template<class Key, class Value, typename Compare>
+bool BTreeMap<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+template<class Key, class Value, typename Compare>
+std::size_t BTreeMap<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+* Returns the number of nodes on a root to leaf path, 0 when empty.
+*/
+template<class Key, class Value, typename Compare>
+int BTreeMap<Key, Value, Compare>::height() const
+{
+    return height_;
+}
+
+/**
+* Removes every item. Like the other trees, nodes are only visited when
+* keys or values have destructors to run; the memory goes back a slab
+* at a time.
+*/
+template<class Key, class Value, typename Compare>
+void BTreeMap<Key, Value, Compare>::clear()
+{
+    if(root_ != nullptr
+       && !(std::is_trivially_destructible<Key>::value && std::is_trivially_destructible<Value>::value))
+    {
+        destroySubtree(root_);
+    }
+    root_ = nullptr;
+    size_ = 0;
+    height_ = 0;
+    leafPool_.release();
+    innerPool_.release();
+}
+
+/**
+* Runs the destructors of every node below n. Recursion is bounded by
+* the height, which is small.
+*/
+template<class Key, class Value, typename Compare>
+void BTreeMap<Key, Value, Compare>::destroySubtree(NodeBase* n)
+{
+    if(n->leaf)
+    {
+        static_cast<Leaf*>(n)->~Leaf();
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(n);
+    for(int i = 0; i <= inner->count; ++i)
+    {
+        destroySubtree(inner->children[i]);
+    }
+    inner->~Inner();
+}
+
+template<class Key, class Value, typename Compare>
+typename BTreeMap<Key, Value, Compare>::Leaf* BTreeMap<Key, Value, Compare>::newLeaf()
+{
+    Leaf* leaf = new (leafPool_.allocate()) Leaf();
+    leaf->leaf = true;
+    leaf->count = 0;
+    leaf->prev = nullptr;
+    leaf->next = nullptr;
+    return leaf;
+}
+
+template<class Key, class Value, typename Compare>
+typename BTreeMap<Key, Value, Compare>::Inner* BTreeMap<Key, Value, Compare>::newInner()
+{
+    Inner* inner = new (innerPool_.allocate()) Inner();
+    inner->leaf = false;
+    inner->count = 0;
+    return inner;
+}
+
+template<class Key, class Value, typename Compare>
+void BTreeMap<Key, Value, Compare>::deleteLeaf(Leaf* leaf)
+{
+    leaf->~Leaf();
+    leafPool_.deallocate(leaf);
+}
+
+template<class Key, class Value, typename Compare>
+void BTreeMap<Key, Value, Compare>::deleteInner(Inner* inner)
+{
+    inner->~Inner();
+    innerPool_.deallocate(inner);
+}
+
+/**
+* Returns which child of inner may hold key: the number of separators
+* that are not greater than key.
+*/
+template<class Key, class Value, typename Compare>
+int BTreeMap<Key, Value, Compare>::upperIndex(const Inner* inner, const Key& key) const
+{
+    int lo = 0;
+    int hi = inner->count;
+    while(lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if(comp_(key, inner->keys[mid])) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+/**
+* Returns the first slot in leaf whose key is not less than key.
+*/
+template<class Key, class Value, typename Compare>
+int BTreeMap<Key, Value, Compare>::lowerIndex(const Leaf* leaf, const Key& key) const
+{
+    int lo = 0;
+    int hi = leaf->count;
+    while(lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if(comp_(leaf->keys[mid], key)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+* Descends to the leaf that holds or would hold key. If path is not null
+* the inner nodes visited and the child taken at each are recorded in it
+* and depth is set to their number.
+*/
+template<class Key, class Value, typename Compare>
+typename BTreeMap<Key, Value, Compare>::Leaf*
+BTreeMap<Key, Value, Compare>::findLeaf(const Key& key, PathEntry* path, int& depth) const
+{
+    depth = 0;
+    NodeBase* n = root_;
+    while(!n->leaf)
+    {
+        Inner* inner = static_cast<Inner*>(n);
+        int index = upperIndex(inner, key);
+        if(path != nullptr)
+        {
+            path[depth].node = inner;
+            path[depth].index = index;
+        }
+        ++depth;
+        n = inner->children[index];
+    }
+    return static_cast<Leaf*>(n);
+}
+
+template<class Key, class Value, typename Compare>
+typename BTreeMap<Key, Value, Compare>::iterator BTreeMap<Key, Value, Compare>::begin() const
+{
+    if(root_ == nullptr) return end();
+    NodeBase* n = root_;
+    while(!n->leaf)
+    {
+        n = static_cast<Inner*>(n)->children[0];
+    }
+    return iterator(static_cast<Leaf*>(n), 0);
+}
+
+template<class Key, class Value, typename Compare>
+typename BTreeMap<Key, Value, Compare>::iterator BTreeMap<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key or the end iterator
+* if the key is not in the map.
+*/
+template<class Key, class Value, typename Compare>
+typename BTreeMap<Key, Value, Compare>::iterator BTreeMap<Key, Value, Compare>::find(const Key& key) const
+{
+    if(root_ == nullptr) return end();
+    int depth;
+    Leaf* leaf = findLeaf(key, nullptr, depth);
+    int pos = lowerIndex(leaf, key);
+    if(pos < leaf->count && !comp_(key, leaf->keys[pos]))
+    {
+        return iterator(leaf, pos);
+    }
+    return end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, typename Compare>
+Value& BTreeMap<Key, Value, Compare>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<class Key, class Value, typename Compare>
+Value const & BTreeMap<Key, Value, Compare>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+*/
+template<class Key, class Value, typename Compare>
+void BTreeMap<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    assignOrInsert(keyValuePair.first, keyValuePair.second);
+}
+
+template<class Key, class Value, typename Compare>
+void BTreeMap<Key, Value, Compare>::insert(std::pair<const Key, Value>&& keyValuePair)
+{
+    assignOrInsert(keyValuePair.first, std::move(keyValuePair.second));
+}
+
+/**
+* Shared insert. A full leaf is split in half and the first key of the
+* new right half is pushed up as a separator, splitting inner nodes on
+* the way up as needed.
+*/
+template<class Key, class Value, typename Compare>
+template<typename V>
+void BTreeMap<Key, Value, Compare>::assignOrInsert(const Key& key, V&& value)
+{
+    if(root_ == nullptr)
+    {
+        Leaf* leaf = newLeaf();
+        leaf->keys[0] = key;
+        leaf->values[0] = std::forward<V>(value);
+        leaf->count = 1;
+        root_ = leaf;
+        size_ = 1;
+        height_ = 1;
+        return;
+    }
+
+    PathEntry path[MAX_HEIGHT];
+    int depth;
+    Leaf* leaf = findLeaf(key, path, depth);
+    int pos = lowerIndex(leaf, key);
+    if(pos < leaf->count && !comp_(key, leaf->keys[pos]))
+    {
+        leaf->values[pos] = std::forward<V>(value);
+        return;
+    }
+    ++size_;
+
+    if(leaf->count < LEAF_SLOTS)
+    {
+        std::move_backward(leaf->keys + pos, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        std::move_backward(leaf->values + pos, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+        leaf->keys[pos] = key;
+        leaf->values[pos] = std::forward<V>(value);
+        ++leaf->count;
+        return;
+    }
+
+    //split, moving the upper half into a new leaf to the right
+    Leaf* right = newLeaf();
+    int mid = LEAF_SLOTS / 2;
+    std::move(leaf->keys + mid, leaf->keys + LEAF_SLOTS, right->keys);
+    std::move(leaf->values + mid, leaf->values + LEAF_SLOTS, right->values);
+    right->count = LEAF_SLOTS - mid;
+    leaf->count = mid;
+
+    right->next = leaf->next;
+    if(right->next != nullptr) right->next->prev = right;
+    right->prev = leaf;
+    leaf->next = right;
+
+    Leaf* target = leaf;
+    if(pos > mid)
+    {
+        target = right;
+        pos -= mid;
+    }
+    std::move_backward(target->keys + pos, target->keys + target->count, target->keys + target->count + 1);
+    std::move_backward(target->values + pos, target->values + target->count, target->values + target->count + 1);
+    target->keys[pos] = key;
+    target->values[pos] = std::forward<V>(value);
+    ++target->count;
+
+    insertIntoParent(path, depth, right->keys[0], right);
+}
+
+/**
+* Adds separator and the new node child (which goes right of separator)
+* to the inner node at the end of path, splitting upwards while full.
+*/
+template<class Key, class Value, typename Compare>
+void BTreeMap<Key, Value, Compare>::insertIntoParent(PathEntry* path, int depth, Key separator, NodeBase* child)
+{
+    while(depth > 0)
+    {
+        Inner* parent = path[depth - 1].node;
+        int index = path[depth - 1].index;
+
+        if(parent->count < INNER_SLOTS)
+        {
+            std::move_backward(parent->keys + index, parent->keys + parent->count, parent->keys + parent->count + 1);
+            std::move_backward(
+                parent->children + index + 1, parent->children + parent->count + 1,
+                parent->children + parent->count + 2);
+            parent->keys[index] = std::move(separator);
+            parent->children[index + 1] = child;
+            ++parent->count;
+            return;
+        }
+
+        //full, lay the keys and children out with the new entry in place
+        Key keys[INNER_SLOTS + 1];
+        NodeBase* children[INNER_SLOTS + 2];
+        std::move(parent->keys, parent->keys + index, keys);
+        keys[index] = std::move(separator);
+        std::move(parent->keys + index, parent->keys + INNER_SLOTS, keys + index + 1);
+        std::copy(parent->children, parent->children + index + 1, children);
+        children[index + 1] = child;
+        std::copy(parent->children + index + 1, parent->children + INNER_SLOTS + 1, children + index + 2);
+
+        //left keeps keys [0, mid), keys[mid] moves up, right gets the rest
+        int mid = (INNER_SLOTS + 1) / 2;
+        Inner* right = newInner();
+        std::move(keys, keys + mid, parent->keys);
+        std::copy(children, children + mid + 1, parent->children);
+        parent->count = mid;
+        std::move(keys + mid + 1, keys + INNER_SLOTS + 1, right->keys);
+        std::copy(children + mid + 1, children + INNER_SLOTS + 2, right->children);
+        right->count = INNER_SLOTS - mid;
+
+        separator = std::move(keys[mid]);
+        child = right;
+        --depth;
+    }
+
+    //the root split, grow a new root above it
+    Inner* root = newInner();
+    root->keys[0] = std::move(separator);
+    root->children[0] = root_;
+    root->children[1] = child;
+    root->count = 1;
+    root_ = root;
+    ++height_;
+}
+
+/**
+* Removes the item with the given key, if present. Nodes left less than
+* half full borrow from a sibling or are merged into one.
+*/
+template<class Key, class Value, typename Compare>
+void BTreeMap<Key, Value, Compare>::remove(const Key& key)
+{
+    if(root_ == nullptr) return;
+
+    PathEntry path[MAX_HEIGHT];
+    int depth;
+    Leaf* leaf = findLeaf(key, path, depth);
+    int pos = lowerIndex(leaf, key);
+    if(pos == leaf->count || comp_(key, leaf->keys[pos])) return;
+
+    std::move(leaf->keys + pos + 1, leaf->keys + leaf->count, leaf->keys + pos);
+    std::move(leaf->values + pos + 1, leaf->values + leaf->count, leaf->values + pos);
+    --leaf->count;
+    // leave the vacated slot in a default state so it holds no resources
+    leaf->keys[leaf->count] = Key();
+    leaf->values[leaf->count] = Value();
+    --size_;
+
+    if(depth == 0)
+    {
+        if(leaf->count == 0)
+        {
+            deleteLeaf(leaf);
+            root_ = nullptr;
+            height_ = 0;
+        }
+        return;
+    }
+    if(leaf->count < LEAF_SLOTS / 2)
+    {
+        fixLeafUnderflow(leaf, path, depth);
+    }
+}
+
+/**
+* Refills a leaf that dropped below half full, from a sibling under the
+* same parent if one can spare an item, otherwise by merging with it.
+*/
+template<class Key, class Value, typename Compare>
+void BTreeMap<Key, Value, Compare>::fixLeafUnderflow(Leaf* leaf, PathEntry* path, int depth)
+{
+    Inner* parent = path[depth - 1].node;
+    int index = path[depth - 1].index;
+    Leaf* left = (index > 0) ? static_cast<Leaf*>(parent->children[index - 1]) : nullptr;
+    Leaf* right = (index < parent->count) ? static_cast<Leaf*>(parent->children[index + 1]) : nullptr;
+
+    //borrow the last item of the left sibling
+    if(left != nullptr && left->count > LEAF_SLOTS / 2)
+    {
+        std::move_backward(leaf->keys, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        std::move_backward(leaf->values, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+        --left->count;
+        leaf->keys[0] = std::move(left->keys[left->count]);
+        leaf->values[0] = std::move(left->values[left->count]);
+        ++leaf->count;
+        parent->keys[index - 1] = leaf->keys[0];
+        return;
+    }
+    //borrow the first item of the right sibling
+    if(right != nullptr && right->count > LEAF_SLOTS / 2)
+    {
+        leaf->keys[leaf->count] = std::move(right->keys[0]);
+        leaf->values[leaf->count] = std::move(right->values[0]);
+        ++leaf->count;
+        std::move(right->keys + 1, right->keys + right->count, right->keys);
+        std::move(right->values + 1, right->values + right->count, right->values);
+        --right->count;
+        parent->keys[index] = right->keys[0];
+        return;
+    }
+
+    //merge the right one of the pair into the left one
+    int separator = index - 1;
+    if(left == nullptr)
+    {
+        left = leaf;
+        leaf = right;
+        separator = index;
+    }
+    std::move(leaf->keys, leaf->keys + leaf->count, left->keys + left->count);
+    std::move(leaf->values, leaf->values + leaf->count, left->values + left->count);
+    left->count += leaf->count;
+    left->next = leaf->next;
+    if(left->next != nullptr) left->next->prev = left;
+    deleteLeaf(leaf);
+
+    std::move(parent->keys + separator + 1, parent->keys + parent->count, parent->keys + separator);
+    std::copy(parent->children + separator + 2, parent->children + parent->count + 1, parent->children + separator + 1);
+    --parent->count;
+    fixInnerUnderflow(parent, path, depth - 1);
+}
+
+/**
+* Same as fixLeafUnderflow for an inner node, which rotates items through
+* the parent's separator. inner is path[depth]'s node, or the root when
+* depth is 0.
+*/
+template<class Key, class Value, typename Compare>
+void BTreeMap<Key, Value, Compare>::fixInnerUnderflow(Inner* inner, PathEntry* path, int depth)
+{
+    while(true)
+    {
+        //the root only needs one child; with none left to separate, drop a level
+        if(depth == 0)
+        {
+            if(inner->count == 0)
+            {
+                root_ = inner->children[0];
+                deleteInner(inner);
+                --height_;
+            }
+            return;
+        }
+        if(inner->count >= INNER_SLOTS / 2) return;
+
+        Inner* parent = path[depth - 1].node;
+        int index = path[depth - 1].index;
+        Inner* left = (index > 0) ? static_cast<Inner*>(parent->children[index - 1]) : nullptr;
+        Inner* right = (index < parent->count) ? static_cast<Inner*>(parent->children[index + 1]) : nullptr;
+
+        //rotate the left sibling's last child over
+        if(left != nullptr && left->count > INNER_SLOTS / 2)
+        {
+            std::move_backward(inner->keys, inner->keys + inner->count, inner->keys + inner->count + 1);
+            std::copy_backward(inner->children, inner->children + inner->count + 1, inner->children + inner->count + 2);
+            inner->keys[0] = std::move(parent->keys[index - 1]);
+            inner->children[0] = left->children[left->count];
+            ++inner->count;
+            parent->keys[index - 1] = std::move(left->keys[left->count - 1]);
+            --left->count;
+            return;
+        }
+        //rotate the right sibling's first child over
+        if(right != nullptr && right->count > INNER_SLOTS / 2)
+        {
+            inner->keys[inner->count] = std::move(parent->keys[index]);
+            inner->children[inner->count + 1] = right->children[0];
+            ++inner->count;
+            parent->keys[index] = std::move(right->keys[0]);
+            std::move(right->keys + 1, right->keys + right->count, right->keys);
+            std::copy(right->children + 1, right->children + right->count + 1, right->children);
+            --right->count;
+            return;
+        }
+
+        //merge the right one of the pair, plus the separator, into the left one
+        int separator = index - 1;
+        if(left == nullptr)
+        {
+            left = inner;
+            inner = right;
+            separator = index;
+        }
+        left->keys[left->count] = std::move(parent->keys[separator]);
+        std::move(inner->keys, inner->keys + inner->count, left->keys + left->count + 1);
+        std::copy(inner->children, inner->children + inner->count + 1, left->children + left->count + 1);
+        left->count += inner->count + 1;
+        deleteInner(inner);
+
+        std::move(parent->keys + separator + 1, parent->keys + parent->count, parent->keys + separator);
+        std::copy(parent->children + separator + 2, parent->children + parent->count + 1, parent->children + separator + 1);
+        --parent->count;
+
+        inner = parent;
+        --depth;
+    }
+}
+
+/**
+* Replaces the contents of the map with the key/value pairs in
+* [first, last), with the same sorting and duplicate rules as
+* BinarySearchTree::bulkLoad. Leaves are filled evenly from left to right
+* and each inner level is built over the one below, in O(n).
+*/
+template<class Key, class Value, typename Compare>
+template<typename InputIterator>
+void BTreeMap<Key, Value, Compare>::bulkLoad(InputIterator first, InputIterator last)
+{
+    std::vector<std::pair<Key, Value> > items(first, last);
+    const Compare& comp = comp_;
+    std::stable_sort(items.begin(), items.end(),
+        [&comp](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) { return comp(a.first, b.first); });
+
+    //drop duplicates, keeping the last value given for each key
+    std::size_t kept = 0;
+    for(std::size_t i = 0; i < items.size(); ++i)
+    {
+        if(i + 1 < items.size() && !comp_(items[i].first, items[i + 1].first)) continue;
+        if(kept != i) items[kept] = std::move(items[i]);
+        ++kept;
+    }
+    items.erase(items.begin() + kept, items.end());
+
+    clear();
+    if(items.empty()) return;
+
+    //leaves, spreading the items evenly so none is under half full
+    std::size_t leafCount = (items.size() + LEAF_SLOTS - 1) / LEAF_SLOTS;
+    std::vector<NodeBase*> level;
+    std::vector<Key> lowKeys;
+    Leaf* prev = nullptr;
+    std::size_t next = 0;
+    for(std::size_t i = 0; i < leafCount; ++i)
+    {
+        std::size_t count = items.size() / leafCount + (i < items.size() % leafCount ? 1 : 0);
+        Leaf* leaf = newLeaf();
+        for(std::size_t j = 0; j < count; ++j, ++next)
+        {
+            leaf->keys[j] = std::move(items[next].first);
+            leaf->values[j] = std::move(items[next].second);
+        }
+        leaf->count = static_cast<int>(count);
+        leaf->prev = prev;
+        if(prev != nullptr) prev->next = leaf;
+        prev = leaf;
+        level.push_back(leaf);
+        lowKeys.push_back(leaf->keys[0]);
+    }
+    size_ = items.size();
+    height_ = 1;
+
+    //inner levels until a single root remains
+    while(level.size() > 1)
+    {
+        std::size_t innerCount = (level.size() + INNER_SLOTS) / (INNER_SLOTS + 1);
+        std::vector<NodeBase*> above;
+        std::vector<Key> aboveKeys;
+        std::size_t child = 0;
+        for(std::size_t i = 0; i < innerCount; ++i)
+        {
+            std::size_t count = level.size() / innerCount + (i < level.size() % innerCount ? 1 : 0);
+            Inner* inner = newInner();
+            aboveKeys.push_back(lowKeys[child]);
+            inner->children[0] = level[child++];
+            for(std::size_t j = 1; j < count; ++j, ++child)
+            {
+                inner->keys[j - 1] = lowKeys[child];
+                inner->children[j] = level[child];
+            }
+            inner->count = static_cast<int>(count) - 1;
+            above.push_back(inner);
+        }
+        level.swap(above);
+        lowKeys.swap(aboveKeys);
+        ++height_;
+    }
+    root_ = level[0];
+}
+
+/*
+-----------------------------------------
+End implementations for the BTreeMap class.
+-----------------------------------------
+*/
+
+#endif
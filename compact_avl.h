@@ -0,0 +1,640 @@
+#ifndef COMPACT_AVL_H
+#define COMPACT_AVL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+* An AVL tree for very large maps, storing every node in one array and
+* linking them by 32-bit indices instead of pointers. The balance factor
+* (-1, 0 or 1) lives in the top two bits of the left index, so a node is
+* just the key, the value and two 32-bit words: 16 bytes for <int, int>,
+* where AVLTree's nodes take 48. Indices leave room for 2^30 - 1 items.
+*
+* Like StackAVLTree there are no parent pointers, so updates record their
+* path down from the root and iterators keep a stack. Removing an item
+* moves the array's last node into the freed slot, so the array stays
+* dense and memory is always the items plus the vector's spare capacity
+* (see reserve). Keys and values live inside the nodes, so iterators hand
+* out a small proxy with .first and .second, and any insert or remove
+* invalidates them.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class CompactAVLTree
+{
+private:
+    struct Node
+    {
+        Node(const Key& key, const Value& value);
+
+        Key key;
+        Value value;
+        // children by direction, 0 left and 1 right; link[0] also holds
+        // the balance plus one in its top two bits
+        uint32_t link[2];
+    };
+
+public:
+    CompactAVLTree();
+    explicit CompactAVLTree(const Compare& comp);
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    void reserve(std::size_t n);
+    bool empty() const;
+    std::size_t size() const;
+    std::size_t memoryBytes() const;
+    static std::size_t nodeBytes();
+    bool isBalanced() const;
+
+    /**
+    * An iterator over the items in key order, keeping the path of array
+    * slots still to be visited.
+    */
+    class iterator
+    {
+    public:
+        struct reference
+        {
+            const Key& first;
+            Value& second;
+        };
+        struct pointer
+        {
+            reference ref;
+            reference* operator->() { return &ref; }
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    private:
+        friend class CompactAVLTree<Key, Value, Compare>;
+        explicit iterator(const CompactAVLTree* tree);
+        void pushLeft(uint32_t n);
+        const CompactAVLTree* tree_;
+        // the current slot last, below it every ancestor still to be visited
+        std::vector<uint32_t> path_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+    // The index that stands for "no node"; also the most items there can be
+    static const uint32_t NIL = (1u << 30) - 1;
+
+private:
+    static const uint32_t INDEX_MASK = NIL;
+    static const int BALANCE_SHIFT = 30;
+    // An AVL tree of 2^30 nodes is under 45 deep
+    static const int MAX_HEIGHT = 48;
+
+    // The path from the root to the node an update is working on: node[i]
+    // and the direction the path took from it.
+    struct Path
+    {
+        uint32_t node[MAX_HEIGHT];
+        int dir[MAX_HEIGHT];
+        int depth;
+    };
+
+    uint32_t child(uint32_t n, int dir) const;
+    void setChild(uint32_t n, int dir, uint32_t c);
+    int balance(uint32_t n) const;
+    void setBalance(uint32_t n, int balance);
+    void setLink(const Path& path, int i, uint32_t n);
+    uint32_t rebalance(uint32_t n, int nBalance);
+    int checkedHeight(uint32_t n) const;
+    uint32_t findNode(const Key& key) const;
+    void moveLastTo(uint32_t hole);
+
+    uint32_t root_;
+    // Value is mutable through iterators of a const tree, as with
+    // BinarySearchTree's iterators
+    mutable std::vector<Node> nodes_;
+    Compare comp_;
+};
+
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::Node::Node(const Key& key, const Value& value) :
+    key(key),
+    value(value)
+{
+    link[0] = NIL | (1u << BALANCE_SHIFT);
+    link[1] = NIL;
+}
+
+/*
+----------------------------------------------------
+Begin implementations for the CompactAVLTree::iterator class.
+----------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::iterator::iterator() :
+    tree_(nullptr)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::iterator::iterator(const CompactAVLTree* tree) :
+    tree_(tree)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator::reference
+CompactAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    Node& n = tree_->nodes_[path_.back()];
+    reference ref = {n.key, n.value};
+    return ref;
+}
+
+/**
+* Provides member access to the item, e.g. it->second.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator::pointer
+CompactAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    pointer ptr = {**this};
+    return ptr;
+}
+
+/**
+* Iterators are equal when they are at the same slot; all end iterators
+* have an empty path.
+*/
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    if(path_.empty() || rhs.path_.empty()) return path_.empty() && rhs.path_.empty();
+    return path_.back() == rhs.path_.back();
+}
+
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Pushes n and its chain of left children, ending at the smallest node
+* of n's subtree.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::iterator::pushLeft(uint32_t n)
+{
+    while(n != NIL)
+    {
+        path_.push_back(n);
+        n = tree_->child(n, 0);
+    }
+}
+
+/**
+* Advances to the smallest node of the right subtree if there is one,
+* otherwise to the nearest ancestor still on the path.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator&
+CompactAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    uint32_t current = path_.back();
+    path_.pop_back();
+    pushLeft(tree_->child(current, 1));
+    return *this;
+}
+
+/*
+--------------------------------------------------
+End implementations for the CompactAVLTree::iterator class.
+--------------------------------------------------
+*/
+
+/*
+-------------------------------------------
+Begin implementations for the CompactAVLTree class.
+-------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::CompactAVLTree() :
+    root_(NIL), comp_()
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by the given comparator.
+*/
+template<class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::CompactAVLTree(const Compare& comp) :
+    root_(NIL), comp_(comp)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::clear()
+{
+    std::vector<Node>().swap(nodes_);
+    root_ = NIL;
+}
+
+/**
+* Makes room for n items up front, so a map of known size is built
+* without the vector's doubling overshooting it.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::reserve(std::size_t n)
+{
+    nodes_.reserve(n);
+}
+
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::empty() const
+{
+    return nodes_.empty();
+}
+
+template<class Key, class Value, class Compare>
+std::size_t CompactAVLTree<Key, Value, Compare>::size() const
+{
+    return nodes_.size();
+}
+
+/**
+* The bytes held for nodes, including spare capacity.
+*/
+template<class Key, class Value, class Compare>
+std::size_t CompactAVLTree<Key, Value, Compare>::memoryBytes() const
+{
+    return nodes_.capacity() * sizeof(Node);
+}
+
+/**
+* The array memory each item takes.
+*/
+template<class Key, class Value, class Compare>
+std::size_t CompactAVLTree<Key, Value, Compare>::nodeBytes()
+{
+    return sizeof(Node);
+}
+
+/**
+* Return true iff every node's packed balance is its right height minus
+* its left height.
+*/
+template<class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    return checkedHeight(root_) != -1;
+}
+
+/**
+* The height of the subtree at slot n, or -1 if a balance under it is
+* wrong. The packed balance cannot hold anything outside -1 to 1.
+*/
+template<class Key, class Value, class Compare>
+int CompactAVLTree<Key, Value, Compare>::checkedHeight(uint32_t n) const
+{
+    if(n == NIL) return 0;
+    int left = checkedHeight(child(n, 0));
+    int right = checkedHeight(child(n, 1));
+    if(left == -1 || right == -1 || balance(n) != right - left) return -1;
+    return std::max(left, right) + 1;
+}
+
+template<class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::child(uint32_t n, int dir) const
+{
+    return nodes_[n].link[dir] & INDEX_MASK;
+}
+
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setChild(uint32_t n, int dir, uint32_t c)
+{
+    uint32_t& link = nodes_[n].link[dir];
+    link = (link & ~INDEX_MASK) | c;
+}
+
+template<class Key, class Value, class Compare>
+int CompactAVLTree<Key, Value, Compare>::balance(uint32_t n) const
+{
+    return static_cast<int>(nodes_[n].link[0] >> BALANCE_SHIFT) - 1;
+}
+
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setBalance(uint32_t n, int balance)
+{
+    uint32_t& link = nodes_[n].link[0];
+    link = (link & INDEX_MASK) | (static_cast<uint32_t>(balance + 1) << BALANCE_SHIFT);
+}
+
+/**
+* Makes n the subtree at path.node[i]'s place: the root, or a child of the
+* node above it.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setLink(const Path& path, int i, uint32_t n)
+{
+    if(i == 0) root_ = n;
+    else setChild(path.node[i - 1], path.dir[i - 1], n);
+}
+
+/**
+* Fixes n, whose balance has reached nBalance (2 or -2, which the packed
+* field cannot hold), with a single or double rotation towards its taller
+* side and returns the subtree's new top. Balances are set from the
+* textbook cases; they are written as if the taller side were the right,
+* and sign flips them for the left.
+*/
+template<class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::rebalance(uint32_t n, int nBalance)
+{
+    int dir = (nBalance > 0) ? 1 : 0;
+    int sign = dir ? 1 : -1;
+    uint32_t c = child(n, dir);
+    int cBalance = sign * balance(c);
+    if(cBalance >= 0)
+    {
+        setChild(n, dir, child(c, 1 - dir));
+        setChild(c, 1 - dir, n);
+        //a balanced child only happens on remove
+        setBalance(n, (cBalance == 0) ? sign : 0);
+        setBalance(c, (cBalance == 0) ? -sign : 0);
+        return c;
+    }
+    uint32_t g = child(c, 1 - dir);
+    int gBalance = sign * balance(g);
+    setChild(c, 1 - dir, child(g, dir));
+    setChild(n, dir, child(g, 1 - dir));
+    setChild(g, dir, c);
+    setChild(g, 1 - dir, n);
+    setBalance(n, (gBalance == 1) ? -sign : 0);
+    setBalance(c, (gBalance == -1) ? sign : 0);
+    setBalance(g, 0);
+    return g;
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+* Same retracing as StackAVLTree::insert, except that a balance reaching
+* 2 or -2 is never stored: the node is rebalanced instead.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Key& key = keyValuePair.first;
+    Path path;
+    path.depth = 0;
+    uint32_t current = root_;
+    while(current != NIL)
+    {
+        int dir;
+        if(comp_(key, nodes_[current].key)) dir = 0;
+        else if(comp_(nodes_[current].key, key)) dir = 1;
+        else
+        {
+            nodes_[current].value = keyValuePair.second;
+            return;
+        }
+        path.node[path.depth] = current;
+        path.dir[path.depth] = dir;
+        ++path.depth;
+        current = child(current, dir);
+    }
+    if(nodes_.size() >= NIL) throw std::length_error("CompactAVLTree is full");
+    uint32_t fresh = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(Node(key, keyValuePair.second));
+    setLink(path, path.depth, fresh);
+
+    for(int i = path.depth - 1; i >= 0; --i)
+    {
+        uint32_t p = path.node[i];
+        int updated = balance(p) + (path.dir[i] ? 1 : -1);
+        if(updated == 0)
+        {
+            setBalance(p, 0);
+            break;
+        }
+        if(updated == 1 || updated == -1)
+        {
+            setBalance(p, updated);
+            continue;
+        }
+        setLink(path, i, rebalance(p, updated));
+        break;
+    }
+}
+
+/**
+* Removes the key if present, as StackAVLTree::remove does, and then moves
+* the last node of the array into the slot that was freed.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    Path path;
+    path.depth = 0;
+    uint32_t target = root_;
+    while(target != NIL)
+    {
+        int dir;
+        if(comp_(key, nodes_[target].key)) dir = 0;
+        else if(comp_(nodes_[target].key, key)) dir = 1;
+        else break;
+        path.node[path.depth] = target;
+        path.dir[path.depth] = dir;
+        ++path.depth;
+        target = child(target, dir);
+    }
+    if(target == NIL) return;
+
+    if(child(target, 0) != NIL && child(target, 1) != NIL)
+    {
+        int targetDepth = path.depth;
+        path.node[path.depth] = target;
+        path.dir[path.depth] = 1;
+        ++path.depth;
+        uint32_t successor = child(target, 1);
+        while(child(successor, 0) != NIL)
+        {
+            path.node[path.depth] = successor;
+            path.dir[path.depth] = 0;
+            ++path.depth;
+            successor = child(successor, 0);
+        }
+        //unhook the successor, then put it where target was
+        setLink(path, path.depth, child(successor, 1));
+        setChild(successor, 0, child(target, 0));
+        setChild(successor, 1, child(target, 1));
+        setBalance(successor, balance(target));
+        setLink(path, targetDepth, successor);
+        path.node[targetDepth] = successor;
+    }
+    else
+    {
+        setLink(path, path.depth, child(target, 0) != NIL ? child(target, 0) : child(target, 1));
+    }
+
+    for(int i = path.depth - 1; i >= 0; --i)
+    {
+        uint32_t p = path.node[i];
+        int updated = balance(p) - (path.dir[i] ? 1 : -1);
+        if(updated == 1 || updated == -1)
+        {
+            setBalance(p, updated);
+            break;
+        }
+        if(updated == 0)
+        {
+            setBalance(p, 0);
+            continue;
+        }
+        //rotating around a balanced child leaves the height as it was
+        bool shorter = balance(child(p, 1 - path.dir[i])) != 0;
+        setLink(path, i, rebalance(p, updated));
+        if(!shorter) break;
+    }
+    moveLastTo(target);
+}
+
+/**
+* Moves the array's last node into hole, which no longer belongs to the
+* tree, and repoints the link that led to it.
+*/
+template<class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::moveLastTo(uint32_t hole)
+{
+    uint32_t last = static_cast<uint32_t>(nodes_.size() - 1);
+    if(hole != last)
+    {
+        const Key& key = nodes_[last].key;
+        uint32_t parent = NIL;
+        int dir = 0;
+        for(uint32_t current = root_; current != last; current = child(current, dir))
+        {
+            parent = current;
+            dir = comp_(key, nodes_[current].key) ? 0 : 1;
+        }
+        nodes_[hole] = std::move(nodes_[last]);
+        if(parent == NIL) root_ = hole;
+        else setChild(parent, dir, hole);
+    }
+    nodes_.pop_back();
+}
+
+/**
+* The slot holding key, or NIL.
+*/
+template<class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::findNode(const Key& key) const
+{
+    uint32_t current = root_;
+    while(current != NIL)
+    {
+        if(comp_(key, nodes_[current].key)) current = child(current, 0);
+        else if(comp_(nodes_[current].key, key)) current = child(current, 1);
+        else return current;
+    }
+    return NIL;
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::begin() const
+{
+    iterator it(this);
+    it.pushLeft(root_);
+    return it;
+}
+
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator(this);
+}
+
+/**
+* Returns an iterator to the item with the given key or end() if the key
+* is not in the tree. Slots where the search turns left are kept on the
+* iterator's path since they come after the result.
+*/
+template<class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it(this);
+    uint32_t current = root_;
+    while(current != NIL)
+    {
+        if(comp_(key, nodes_[current].key))
+        {
+            it.path_.push_back(current);
+            current = child(current, 0);
+        }
+        else if(comp_(nodes_[current].key, key))
+        {
+            current = child(current, 1);
+        }
+        else
+        {
+            it.path_.push_back(current);
+            return it;
+        }
+    }
+    return end();
+}
+
+/**
+ * @precondition The key exists in the tree
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value& CompactAVLTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    uint32_t n = findNode(key);
+    if(n == NIL) throw std::out_of_range("Invalid key");
+    return nodes_[n].value;
+}
+
+template<class Key, class Value, class Compare>
+Value const & CompactAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    uint32_t n = findNode(key);
+    if(n == NIL) throw std::out_of_range("Invalid key");
+    return nodes_[n].value;
+}
+
+/*
+-----------------------------------------
+End implementations for the CompactAVLTree class.
+-----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,361 @@
+#ifndef CONCURRENT_AVL_H
+#define CONCURRENT_AVL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "persistent_avl.h"
+
+/**
+* An AVL tree that many threads can use at once. Writers (insert, remove,
+* clear) take a mutex, as before. Readers (find, contains, forEachInRange,
+* size) take no lock and never retry. The tree is a PersistentAVLTree, whose
+* nodes are never written once built: a writer makes its change on new
+* copies of the nodes along the path and then publishes the new root with
+* one atomic store, so every reader walks a version of the tree that
+* nothing will write to again, and sees every field of it as the writer
+* built it.
+*
+* What is left is deciding when an old version's nodes may be freed. A
+* reader names the root it is walking in a hazard slot, one of
+* READER_SLOTS cache lines picked by thread; a writer keeps each version it
+* replaces until no slot names that version's root, checking again after
+* every write. Readers write only to their own slot and writers never wait
+* for readers.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class ConcurrentAVLTree
+{
+public:
+    ConcurrentAVLTree();
+    explicit ConcurrentAVLTree(const Compare& comp);
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    template<typename Function>
+    void forEachInRange(const Key& lo, const Key& hi, Function fn) const;
+    bool empty() const;
+    std::size_t size() const;
+
+private:
+    // Exposes the nodes of PersistentAVLTree the readers walk.
+    class Tree : public PersistentAVLTree<Key, Value, Compare>
+    {
+    public:
+        typedef typename PersistentAVLTree<Key, Value, Compare>::Node Node;
+        explicit Tree(const Compare& comp) : PersistentAVLTree<Key, Value, Compare>(comp) {}
+        const Node* root() const { return PersistentAVLTree<Key, Value, Compare>::root_; }
+        const Compare& comp() const { return PersistentAVLTree<Key, Value, Compare>::comp_; }
+    };
+    typedef typename Tree::Node TreeNode;
+
+    // The root a reader is walking, or null when the slot is free. Padded
+    // so that readers on different slots share no cache line.
+    struct ReaderSlot
+    {
+        std::atomic<const TreeNode*> root;
+        char pad[64 - sizeof(std::atomic<const TreeNode*>)];
+    };
+
+    // Holds a slot naming the current root for as long as it lives.
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const ConcurrentAVLTree& tree);
+        ~ReadGuard();
+        const TreeNode* root() const;
+
+    private:
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        std::atomic<const TreeNode*>* slot_;
+        const TreeNode* root_;
+    };
+
+    // More simultaneous readers than this take turns for slots
+    static const std::size_t READER_SLOTS = 64;
+
+    void publish();
+    const TreeNode* search(const TreeNode* root, const Key& key) const;
+
+    // The writer's current version and the ones it replaced that readers
+    // may still be walking, both only touched with writeLock_ held
+    Tree tree_;
+    std::vector<Tree> retired_;
+    std::mutex writeLock_;
+    std::atomic<const TreeNode*> root_;
+    mutable ReaderSlot slots_[READER_SLOTS];
+};
+
+/*
+-------------------------------------------
+Begin implementations for the ConcurrentAVLTree::ReadGuard class.
+-------------------------------------------
+*/
+
+/**
+* Claims a free slot, starting from one picked by thread, and names the
+* current root in it. The root may be replaced (and even freed) between
+* loading it and naming it, so the guard then checks it is still the root
+* and tries again if not; once a writer could see the slot, the version
+* it names is kept.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ReadGuard::ReadGuard(const ConcurrentAVLTree& tree) :
+    slot_(nullptr), root_(tree.root_.load())
+{
+    //an empty tree has nothing to free
+    if(root_ == nullptr) return;
+
+    static thread_local const std::size_t home =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) % READER_SLOTS;
+    std::size_t i = home;
+    const TreeNode* expected = nullptr;
+    while(!tree.slots_[i].root.compare_exchange_strong(expected, root_))
+    {
+        expected = nullptr;
+        i = (i + 1) % READER_SLOTS;
+        if(i == home) std::this_thread::yield();
+    }
+    slot_ = &tree.slots_[i].root;
+
+    for(const TreeNode* current = tree.root_.load(); current != root_; current = tree.root_.load())
+    {
+        root_ = current;
+        if(root_ == nullptr)
+        {
+            slot_->store(nullptr, std::memory_order_release);
+            slot_ = nullptr;
+            return;
+        }
+        slot_->store(root_);
+    }
+}
+
+/**
+* Frees the slot, letting a writer drop the version if it has been
+* replaced.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ReadGuard::~ReadGuard()
+{
+    if(slot_ != nullptr) slot_->store(nullptr, std::memory_order_release);
+}
+
+template<class Key, class Value, class Compare>
+const typename ConcurrentAVLTree<Key, Value, Compare>::TreeNode*
+ConcurrentAVLTree<Key, Value, Compare>::ReadGuard::root() const
+{
+    return root_;
+}
+
+/*
+-----------------------------------------
+End implementations for the ConcurrentAVLTree::ReadGuard class.
+-----------------------------------------
+*/
+
+/*
+-------------------------------------------
+Begin implementations for the ConcurrentAVLTree class.
+-------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree() :
+    tree_(Compare()), root_(nullptr)
+{
+    for(std::size_t i = 0; i < READER_SLOTS; ++i)
+    {
+        slots_[i].root.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Constructor for an empty tree ordered by the given comparator.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree(const Compare& comp) :
+    tree_(comp), root_(nullptr)
+{
+    for(std::size_t i = 0; i < READER_SLOTS; ++i)
+    {
+        slots_[i].root.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    retired_.push_back(tree_);
+    tree_.insert(keyValuePair);
+    publish();
+}
+
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    retired_.push_back(tree_);
+    tree_.remove(key);
+    publish();
+}
+
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::clear()
+{
+    std::lock_guard<std::mutex> guard(writeLock_);
+    retired_.push_back(tree_);
+    tree_.clear();
+    publish();
+}
+
+/**
+* Makes tree_ the version readers see, then drops the replaced versions
+* whose roots no reader names any more. Called with writeLock_ held. The
+* store of the root is what orders every node of the new version before a
+* reader's first look at it.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::publish()
+{
+    root_.store(tree_.root());
+
+    std::vector<const TreeNode*> walked;
+    for(std::size_t i = 0; i < READER_SLOTS; ++i)
+    {
+        const TreeNode* root = slots_[i].root.load();
+        if(root != nullptr) walked.push_back(root);
+    }
+    std::size_t kept = 0;
+    for(std::size_t i = 0; i < retired_.size(); ++i)
+    {
+        if(std::find(walked.begin(), walked.end(), retired_[i].root()) != walked.end())
+        {
+            retired_[kept++] = std::move(retired_[i]);
+        }
+    }
+    retired_.erase(retired_.begin() + kept, retired_.end());
+}
+
+/**
+* The same single-comparison descent as internalFind, in the version under
+* root.
+*/
+template<class Key, class Value, class Compare>
+const typename ConcurrentAVLTree<Key, Value, Compare>::TreeNode*
+ConcurrentAVLTree<Key, Value, Compare>::search(const TreeNode* root, const Key& key) const
+{
+    const Compare& comp = tree_.comp();
+    const TreeNode* current = root;
+    const TreeNode* candidate = nullptr;
+    while(current != nullptr)
+    {
+        if(comp(current->item.first, key))
+        {
+            current = current->right;
+        }
+        else
+        {
+            candidate = current;
+            current = current->left;
+        }
+    }
+    if(candidate != nullptr && !comp(key, candidate->item.first))
+    {
+        return candidate;
+    }
+    return nullptr;
+}
+
+/**
+* If key is present copies its value into value and returns true.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::find(const Key& key, Value& value) const
+{
+    ReadGuard guard(*this);
+    const TreeNode* found = search(guard.root(), key);
+    if(found == nullptr) return false;
+    value = found->item.second;
+    return true;
+}
+
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::contains(const Key& key) const
+{
+    ReadGuard guard(*this);
+    return search(guard.root(), key) != nullptr;
+}
+
+/**
+* Calls fn on every item with lo <= key < hi, in order, all from the one
+* version that was current when the scan began. A slow fn only keeps that
+* version's nodes around for longer; it never holds up a writer.
+*/
+template<class Key, class Value, class Compare>
+template<typename Function>
+void ConcurrentAVLTree<Key, Value, Compare>::forEachInRange(const Key& lo, const Key& hi, Function fn) const
+{
+    const Compare& comp = tree_.comp();
+    ReadGuard guard(*this);
+    //the nodes still to visit, nearest last, as PersistentAVLTree::iterator keeps them
+    std::vector<const TreeNode*> path;
+    for(const TreeNode* current = guard.root(); current != nullptr; )
+    {
+        if(comp(current->item.first, lo))
+        {
+            current = current->right;
+        }
+        else
+        {
+            path.push_back(current);
+            current = current->left;
+        }
+    }
+    while(!path.empty() && comp(path.back()->item.first, hi))
+    {
+        const TreeNode* current = path.back();
+        path.pop_back();
+        fn(current->item);
+        for(const TreeNode* n = current->right; n != nullptr; n = n->left)
+        {
+            path.push_back(n);
+        }
+    }
+}
+
+template<class Key, class Value, class Compare>
+std::size_t ConcurrentAVLTree<Key, Value, Compare>::size() const
+{
+    ReadGuard guard(*this);
+    return (guard.root() == nullptr) ? 0 : guard.root()->size;
+}
+
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::empty() const
+{
+    return root_.load() == nullptr;
+}
+
+/*
+-----------------------------------------
+End implementations for the ConcurrentAVLTree class.
+-----------------------------------------
+*/
+
+#endif
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cstdlib>
+#include <vector>
 #include "equal-paths.h"
 using namespace std;
 
@@ -108,6 +109,26 @@ void test9(const char* msg)
   cout << msg << ": " <<   equalPaths(a) << endl;
 }
 
+//true
+void test10(const char* msg)
+{
+  // a single long path is far deeper than the call stack allows recursing
+  std::vector<Node*> chain;
+  for(int i = 0; i < 1000000; ++i) {
+    chain.push_back(new Node(i));
+    if(i > 0) chain[i-1]->left = chain[i];
+  }
+  cout << msg << ": " <<   equalPaths(chain[0]) << endl;
+
+  //false once a short leaf is hung off the top
+  chain[0]->right = new Node(-1);
+  cout << msg << "b: " <<   equalPaths(chain[0]) << endl;
+  delete chain[0]->right;
+  for(size_t i = 0; i < chain.size(); ++i) {
+    delete chain[i];
+  }
+}
+
 
 int main()
 {
@@ -128,6 +149,7 @@ int main()
   test7("Test7");
   test8("Test8");
   test9("Test9");
+  test10("Test10");
  
   delete a;
   delete b;
@@ -1,3 +1,5 @@
+#include <utility>
+#include <vector>
 #include "equal-paths.h"
 using namespace std;
 
@@ -13,14 +15,44 @@ bool equalPaths(Node * root)
         return true;
     }
 
-    if(depth(root -> left) == depth(root -> right) || ((depth(root -> left) <= 1) && (depth(root -> right) <= 1)))
+    // One depth-first pass over the tree, comparing the depth of every
+    // leaf against the first one found and stopping at the first mismatch.
+    // The stack of pending (node, depth) pairs lives on the heap and only
+    // ever holds O(height) entries, so a degenerate tree as deep as it is
+    // large does not overflow the call stack.
+    vector<pair<Node*, int> > pending;
+    pending.push_back(make_pair(root, 1));
+    int leafDepth = -1;
+    while(!pending.empty())
     {
-        return true;
-    }
-    else
-    {
-        return false;
+        Node* current = pending.back().first;
+        int currentDepth = pending.back().second;
+        pending.pop_back();
+
+        //leaf
+        if(current -> left == nullptr && current -> right == nullptr)
+        {
+            if(leafDepth == -1)
+            {
+                leafDepth = currentDepth;
+            }
+            else if(leafDepth != currentDepth)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if(current -> right != nullptr)
+        {
+            pending.push_back(make_pair(current -> right, currentDepth + 1));
+        }
+        if(current -> left != nullptr)
+        {
+            pending.push_back(make_pair(current -> left, currentDepth + 1));
+        }
     }
+    return true;
 }
 
 int depth(Node*root){
@@ -30,4 +62,4 @@ int depth(Node*root){
     }
 
     return max(depth(root -> left) + 1, depth(root -> right) + 1);
-}
\ No newline at end of file
+}
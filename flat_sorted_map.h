@@ -0,0 +1,605 @@
+#ifndef FLAT_SORTED_MAP_H
+#define FLAT_SORTED_MAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FLAT_SORTED_MAP_X86 1
+#endif
+
+/**
+* The widest search kernel this CPU can run, checked once at run time so
+* the same binary works with or without AVX2.
+*/
+enum FlatSearchLevel
+{
+    FLAT_SEARCH_SCALAR,
+    FLAT_SEARCH_SSE,
+    FLAT_SEARCH_AVX2
+};
+
+inline FlatSearchLevel flatSearchLevel()
+{
+#ifdef FLAT_SORTED_MAP_X86
+    static const FlatSearchLevel level =
+        __builtin_cpu_supports("avx2") ? FLAT_SEARCH_AVX2
+        : __builtin_cpu_supports("sse4.2") ? FLAT_SEARCH_SSE
+        : FLAT_SEARCH_SCALAR;
+    return level;
+#else
+    return FLAT_SEARCH_SCALAR;
+#endif
+}
+
+inline const char* flatSearchLevelName(FlatSearchLevel level)
+{
+    switch(level)
+    {
+    case FLAT_SEARCH_AVX2: return "avx2";
+    case FLAT_SEARCH_SSE: return "sse4.2";
+    default: return "scalar";
+    }
+}
+
+/*
+  The kernels below count how many of the FLAT_SEARCH_BLOCK keys starting
+  at keys are less than key. flip is xor-ed into both sides first; the
+  vector compares are signed, so unsigned keys pass their sign bit here.
+  The vector kernels take the keys untyped: the unaligned __m128i/__m256i
+  loads may alias any type, so keys of any integer type of the lane's width
+  are read without breaking the aliasing rules. The scalar kernel reads
+  them as their own type and converts.
+*/
+
+static const std::size_t FLAT_SEARCH_BLOCK = 16;
+
+template<typename K, typename T>
+inline std::size_t flatCountLessScalar(const K* keys, T key, T flip)
+{
+    std::size_t count = 0;
+    for(std::size_t i = 0; i < FLAT_SEARCH_BLOCK; ++i)
+    {
+        count += static_cast<std::size_t>(static_cast<T>(static_cast<T>(keys[i]) ^ flip) < static_cast<T>(key ^ flip));
+    }
+    return count;
+}
+
+#ifdef FLAT_SORTED_MAP_X86
+__attribute__((target("avx2")))
+inline std::size_t flatCountLessAvx2(const void* keys, std::int32_t key, std::int32_t flip)
+{
+    const __m256i* block = static_cast<const __m256i*>(keys);
+    __m256i f = _mm256_set1_epi32(flip);
+    __m256i k = _mm256_xor_si256(_mm256_set1_epi32(key), f);
+    __m256i a = _mm256_xor_si256(_mm256_loadu_si256(block), f);
+    __m256i b = _mm256_xor_si256(_mm256_loadu_si256(block + 1), f);
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, a))))
+                  | static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, b)))) << 8;
+    return static_cast<std::size_t>(__builtin_popcount(mask));
+}
+
+__attribute__((target("avx2")))
+inline std::size_t flatCountLessAvx2(const void* keys, std::int64_t key, std::int64_t flip)
+{
+    const __m256i* block = static_cast<const __m256i*>(keys);
+    __m256i f = _mm256_set1_epi64x(flip);
+    __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(key), f);
+    unsigned mask = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+        __m256i a = _mm256_xor_si256(_mm256_loadu_si256(block + i), f);
+        mask |= static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, a)))) << (4 * i);
+    }
+    return static_cast<std::size_t>(__builtin_popcount(mask));
+}
+
+__attribute__((target("sse4.2")))
+inline std::size_t flatCountLessSse(const void* keys, std::int32_t key, std::int32_t flip)
+{
+    const __m128i* block = static_cast<const __m128i*>(keys);
+    __m128i f = _mm_set1_epi32(flip);
+    __m128i k = _mm_xor_si128(_mm_set1_epi32(key), f);
+    unsigned mask = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+        __m128i a = _mm_xor_si128(_mm_loadu_si128(block + i), f);
+        mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, a)))) << (4 * i);
+    }
+    return static_cast<std::size_t>(__builtin_popcount(mask));
+}
+
+__attribute__((target("sse4.2")))
+inline std::size_t flatCountLessSse(const void* keys, std::int64_t key, std::int64_t flip)
+{
+    const __m128i* block = static_cast<const __m128i*>(keys);
+    __m128i f = _mm_set1_epi64x(flip);
+    __m128i k = _mm_xor_si128(_mm_set1_epi64x(key), f);
+    unsigned mask = 0;
+    for(int i = 0; i < 8; ++i)
+    {
+        __m128i a = _mm_xor_si128(_mm_loadu_si128(block + i), f);
+        mask |= static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, a)))) << (2 * i);
+    }
+    return static_cast<std::size_t>(__builtin_popcount(mask));
+}
+#endif
+
+/**
+* A map that keeps its keys in one packed sorted array and its values in a
+* parallel one. Lookups are a binary search over the keys, so there is no
+* pointer chasing, at the cost of O(n) inserts and removes that shift the
+* tail of the arrays; it suits maps that are loaded once (bulkLoad) and then
+* mostly read.
+*
+* When Key is a 32- or 64-bit integer ordered by std::less, the last steps
+* of the search are replaced by a vector kernel comparing 16 keys at once,
+* picked at run time from AVX2, SSE4.2 or plain scalar code. Other key types
+* use std::lower_bound with Compare.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class FlatSortedMap
+{
+public:
+    FlatSortedMap();
+    explicit FlatSortedMap(const Compare& comp);
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void insert(std::pair<const Key, Value>&& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    template<typename InputIterator>
+    void bulkLoad(InputIterator first, InputIterator last);
+    bool empty() const;
+    std::size_t size() const;
+
+    /**
+    * An iterator over the items in key order. Dereferencing gives a
+    * reference proxy whose first and second refer into the arrays; second
+    * is read-only through a const_iterator, which is what a const map
+    * hands out. An iterator converts to a const_iterator.
+    */
+    template<bool IsConst>
+    class Iterator
+    {
+    public:
+        typedef typename std::conditional<IsConst, const Value&, Value&>::type value_reference;
+        struct reference
+        {
+            const Key& first;
+            value_reference second;
+        };
+        struct pointer
+        {
+            reference ref;
+            reference* operator->() { return &ref; }
+        };
+
+        Iterator();
+        Iterator(const Iterator<false>& other);
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const Iterator& rhs) const;
+        bool operator!=(const Iterator& rhs) const;
+
+        Iterator& operator++();
+        Iterator& operator--();
+
+    private:
+        friend class FlatSortedMap<Key, Value, Compare>;
+        template<bool> friend class Iterator;
+        typedef typename std::conditional<IsConst, const FlatSortedMap*, FlatSortedMap*>::type map_pointer;
+        Iterator(map_pointer map, std::size_t index);
+        map_pointer map_;
+        std::size_t index_;
+    };
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+    iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key);
+    const_iterator lower_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+    // True when lookups on this instantiation use the vector kernels.
+    static const bool VECTORIZED =
+        std::is_integral<Key>::value
+        && (sizeof(Key) == 4 || sizeof(Key) == 8)
+        && std::is_same<Compare, std::less<Key> >::value;
+
+private:
+    // Signed integer of the same width as Key, for the kernels.
+    typedef typename std::conditional<sizeof(Key) == 4, std::int32_t, std::int64_t>::type Lane;
+
+    std::size_t lowerBoundIndex(const Key& key) const;
+    std::size_t findIndex(const Key& key) const;
+    std::size_t vectorLowerBound(const Key& key, std::true_type) const;
+    std::size_t vectorLowerBound(const Key& key, std::false_type) const;
+    template<typename V>
+    void assignOrInsert(const Key& key, V&& value);
+
+    std::vector<Key> keys_;
+    std::vector<Value> values_;
+    Compare comp_;
+};
+
+/*
+----------------------------------------------------
+Begin implementations for the FlatSortedMap::Iterator class.
+----------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<class Key, class Value, typename Compare>
+template<bool IsConst>
+FlatSortedMap<Key, Value, Compare>::Iterator<IsConst>::Iterator() :
+    map_(nullptr), index_(0)
+{
+
+}
+
+/**
+* Copies an iterator, or turns one into a const_iterator.
+*/
+template<class Key, class Value, typename Compare>
+template<bool IsConst>
+FlatSortedMap<Key, Value, Compare>::Iterator<IsConst>::Iterator(const Iterator<false>& other) :
+    map_(other.map_), index_(other.index_)
+{
+
+}
+
+/**
+* Explicit constructor for a slot of map; the slot past the last is the end.
+*/
+template<class Key, class Value, typename Compare>
+template<bool IsConst>
+FlatSortedMap<Key, Value, Compare>::Iterator<IsConst>::Iterator(map_pointer map, std::size_t index) :
+    map_(map), index_(index)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, typename Compare>
+template<bool IsConst>
+typename FlatSortedMap<Key, Value, Compare>::template Iterator<IsConst>::reference
+FlatSortedMap<Key, Value, Compare>::Iterator<IsConst>::operator*() const
+{
+    reference ref = {map_->keys_[index_], map_->values_[index_]};
+    return ref;
+}
+
+/**
+* Provides member access to the item, e.g. it->second.
+*/
+template<class Key, class Value, typename Compare>
+template<bool IsConst>
+typename FlatSortedMap<Key, Value, Compare>::template Iterator<IsConst>::pointer
+FlatSortedMap<Key, Value, Compare>::Iterator<IsConst>::operator->() const
+{
+    pointer ptr = {**this};
+    return ptr;
+}
+
+template<class Key, class Value, typename Compare>
+template<bool IsConst>
+bool FlatSortedMap<Key, Value, Compare>::Iterator<IsConst>::operator==(const Iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<class Key, class Value, typename Compare>
+template<bool IsConst>
+bool FlatSortedMap<Key, Value, Compare>::Iterator<IsConst>::operator!=(const Iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value, typename Compare>
+template<bool IsConst>
+typename FlatSortedMap<Key, Value, Compare>::template Iterator<IsConst>&
+FlatSortedMap<Key, Value, Compare>::Iterator<IsConst>::operator++()
+{
+    ++index_;
+    return *this;
+}
+
+template<class Key, class Value, typename Compare>
+template<bool IsConst>
+typename FlatSortedMap<Key, Value, Compare>::template Iterator<IsConst>&
+FlatSortedMap<Key, Value, Compare>::Iterator<IsConst>::operator--()
+{
+    --index_;
+    return *this;
+}
+
+/*
+--------------------------------------------------
+End implementations for the FlatSortedMap::Iterator class.
+--------------------------------------------------
+*/
+
+/*
+-------------------------------------------
+Begin implementations for the FlatSortedMap class.
+-------------------------------------------
+*/
+
+template<class Key, class Value, typename Compare>
+FlatSortedMap<Key, Value, Compare>::FlatSortedMap() :
+    comp_()
+{
+
+}
+
+/**
+* Constructor for an empty map ordered by the given comparator.
+*/
+template<class Key, class Value, typename Compare>
+FlatSortedMap<Key, Value, Compare>::FlatSortedMap(const Compare& comp) :
+    comp_(comp)
+{
+
+}
+
+template<class Key, class Value, typename Compare>
+bool FlatSortedMap<Key, Value, Compare>::empty() const
+{
+    return keys_.empty();
+}
+
+template<class Key, class Value, typename Compare>
+std::size_t FlatSortedMap<Key, Value, Compare>::size() const
+{
+    return keys_.size();
+}
+
+template<class Key, class Value, typename Compare>
+void FlatSortedMap<Key, Value, Compare>::clear()
+{
+    keys_.clear();
+    values_.clear();
+}
+
+/**
+* Returns the index of the first key not less than key, or size().
+*/
+template<class Key, class Value, typename Compare>
+std::size_t FlatSortedMap<Key, Value, Compare>::lowerBoundIndex(const Key& key) const
+{
+    return vectorLowerBound(key, std::integral_constant<bool, VECTORIZED>());
+}
+
+template<class Key, class Value, typename Compare>
+std::size_t FlatSortedMap<Key, Value, Compare>::vectorLowerBound(const Key& key, std::false_type) const
+{
+    return std::lower_bound(keys_.begin(), keys_.end(), key, comp_) - keys_.begin();
+}
+
+/**
+* Halves [lo, lo + len) until at most a block of keys is left, then counts
+* the keys below key in a block-sized window ending no later than the
+* array. Keys in the window before lo are all below key and those after the
+* range are not, so the count gives the answer without any further branches.
+*/
+template<class Key, class Value, typename Compare>
+std::size_t FlatSortedMap<Key, Value, Compare>::vectorLowerBound(const Key& key, std::true_type) const
+{
+    const std::size_t n = keys_.size();
+    if(n < FLAT_SEARCH_BLOCK)
+    {
+        return vectorLowerBound(key, std::false_type());
+    }
+    const Key* keys = keys_.data();
+    const Lane target = static_cast<Lane>(key);
+    // the kernels compare signed lanes, so unsigned keys swap their sign bit
+    const Lane flip = std::is_signed<Key>::value
+                    ? Lane(0)
+                    : static_cast<Lane>(static_cast<typename std::make_unsigned<Lane>::type>(1) << (8 * sizeof(Lane) - 1));
+
+    std::size_t lo = 0;
+    std::size_t len = n;
+    while(len > FLAT_SEARCH_BLOCK)
+    {
+        std::size_t half = len / 2;
+        lo = comp_(keys_[lo + half], key) ? lo + half : lo;
+        len -= half;
+    }
+    std::size_t start = std::min(lo, n - FLAT_SEARCH_BLOCK);
+
+    switch(flatSearchLevel())
+    {
+#ifdef FLAT_SORTED_MAP_X86
+    case FLAT_SEARCH_AVX2:
+        return start + flatCountLessAvx2(keys + start, target, flip);
+    case FLAT_SEARCH_SSE:
+        return start + flatCountLessSse(keys + start, target, flip);
+#endif
+    default:
+        return start + flatCountLessScalar(keys + start, target, flip);
+    }
+}
+
+template<class Key, class Value, typename Compare>
+typename FlatSortedMap<Key, Value, Compare>::iterator FlatSortedMap<Key, Value, Compare>::begin()
+{
+    return iterator(this, 0);
+}
+
+template<class Key, class Value, typename Compare>
+typename FlatSortedMap<Key, Value, Compare>::iterator FlatSortedMap<Key, Value, Compare>::end()
+{
+    return iterator(this, keys_.size());
+}
+
+template<class Key, class Value, typename Compare>
+typename FlatSortedMap<Key, Value, Compare>::const_iterator FlatSortedMap<Key, Value, Compare>::begin() const
+{
+    return const_iterator(this, 0);
+}
+
+template<class Key, class Value, typename Compare>
+typename FlatSortedMap<Key, Value, Compare>::const_iterator FlatSortedMap<Key, Value, Compare>::end() const
+{
+    return const_iterator(this, keys_.size());
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, typename Compare>
+typename FlatSortedMap<Key, Value, Compare>::iterator FlatSortedMap<Key, Value, Compare>::lower_bound(const Key& key)
+{
+    return iterator(this, lowerBoundIndex(key));
+}
+
+template<class Key, class Value, typename Compare>
+typename FlatSortedMap<Key, Value, Compare>::const_iterator FlatSortedMap<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return const_iterator(this, lowerBoundIndex(key));
+}
+
+/**
+* Returns the index of the item with the given key, or size() if the key
+* is not in the map.
+*/
+template<class Key, class Value, typename Compare>
+std::size_t FlatSortedMap<Key, Value, Compare>::findIndex(const Key& key) const
+{
+    std::size_t pos = lowerBoundIndex(key);
+    if(pos == keys_.size() || comp_(key, keys_[pos])) return keys_.size();
+    return pos;
+}
+
+/**
+* Returns an iterator to the item with the given key or end() if the key
+* is not in the map.
+*/
+template<class Key, class Value, typename Compare>
+typename FlatSortedMap<Key, Value, Compare>::iterator FlatSortedMap<Key, Value, Compare>::find(const Key& key)
+{
+    return iterator(this, findIndex(key));
+}
+
+template<class Key, class Value, typename Compare>
+typename FlatSortedMap<Key, Value, Compare>::const_iterator FlatSortedMap<Key, Value, Compare>::find(const Key& key) const
+{
+    return const_iterator(this, findIndex(key));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, typename Compare>
+Value& FlatSortedMap<Key, Value, Compare>::operator[](const Key& key)
+{
+    std::size_t pos = findIndex(key);
+    if(pos == keys_.size()) throw std::out_of_range("Invalid key");
+    return values_[pos];
+}
+
+template<class Key, class Value, typename Compare>
+Value const & FlatSortedMap<Key, Value, Compare>::operator[](const Key& key) const
+{
+    std::size_t pos = findIndex(key);
+    if(pos == keys_.size()) throw std::out_of_range("Invalid key");
+    return values_[pos];
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+* Shifts every later item up by one.
+*/
+template<class Key, class Value, typename Compare>
+void FlatSortedMap<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    assignOrInsert(keyValuePair.first, keyValuePair.second);
+}
+
+template<class Key, class Value, typename Compare>
+void FlatSortedMap<Key, Value, Compare>::insert(std::pair<const Key, Value>&& keyValuePair)
+{
+    assignOrInsert(keyValuePair.first, std::move(keyValuePair.second));
+}
+
+template<class Key, class Value, typename Compare>
+template<typename V>
+void FlatSortedMap<Key, Value, Compare>::assignOrInsert(const Key& key, V&& value)
+{
+    std::size_t pos = lowerBoundIndex(key);
+    if(pos < keys_.size() && !comp_(key, keys_[pos]))
+    {
+        values_[pos] = std::forward<V>(value);
+        return;
+    }
+    keys_.insert(keys_.begin() + pos, key);
+    values_.insert(values_.begin() + pos, std::forward<V>(value));
+}
+
+/**
+* Removes the item with the given key, if present, shifting every later
+* item down by one.
+*/
+template<class Key, class Value, typename Compare>
+void FlatSortedMap<Key, Value, Compare>::remove(const Key& key)
+{
+    std::size_t pos = lowerBoundIndex(key);
+    if(pos == keys_.size() || comp_(key, keys_[pos])) return;
+    keys_.erase(keys_.begin() + pos);
+    values_.erase(values_.begin() + pos);
+}
+
+/**
+* Replaces the contents of the map with the key/value pairs in
+* [first, last), with the same sorting and duplicate rules as
+* BinarySearchTree::bulkLoad.
+*/
+template<class Key, class Value, typename Compare>
+template<typename InputIterator>
+void FlatSortedMap<Key, Value, Compare>::bulkLoad(InputIterator first, InputIterator last)
+{
+    std::vector<std::pair<Key, Value> > items(first, last);
+    const Compare& comp = comp_;
+    std::stable_sort(items.begin(), items.end(),
+        [&comp](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) { return comp(a.first, b.first); });
+
+    clear();
+    keys_.reserve(items.size());
+    values_.reserve(items.size());
+    //keep the last value given for each key
+    for(std::size_t i = 0; i < items.size(); ++i)
+    {
+        if(i + 1 < items.size() && !comp_(items[i].first, items[i + 1].first)) continue;
+        keys_.push_back(std::move(items[i].first));
+        values_.push_back(std::move(items[i].second));
+    }
+}
+
+/*
+-----------------------------------------
+End implementations for the FlatSortedMap class.
+-----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,383 @@
+#ifndef FROZEN_MAP_H
+#define FROZEN_MAP_H
+
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+* An immutable snapshot of a sorted map, laid out in Eytzinger (BFS) order:
+* slot 1 holds the root, and the children of slot k are slots 2k and 2k + 1.
+* There are no pointers to chase; a lookup walks down the array, the first
+* levels share a few cache lines, and the next levels' lines are prefetched
+* while the current comparison is still in flight. The descent is a single
+* index computation per level, so it has no data-dependent branches.
+*
+* Usually obtained from BinarySearchTree::freeze() (and so from AVLTree).
+* Keys and values are stored in separate arrays so a search only reads keys,
+* which means iterators hand out a small proxy with .first and .second.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class FrozenMap
+{
+public:
+    FrozenMap();
+    template<typename InputIterator>
+    FrozenMap(InputIterator first, InputIterator last, const Compare& comp = Compare());
+
+    bool empty() const;
+    std::size_t size() const;
+
+    /**
+    * An iterator over the items in key order.
+    */
+    class iterator
+    {
+    public:
+        struct reference
+        {
+            const Key& first;
+            const Value& second;
+        };
+        struct pointer
+        {
+            reference ref;
+            reference* operator->() { return &ref; }
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator& operator--();
+
+    private:
+        friend class FrozenMap<Key, Value, Compare>;
+        iterator(const FrozenMap* map, std::size_t index);
+        const FrozenMap* map_;
+        std::size_t index_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+private:
+    std::size_t lowerBoundIndex(const Key& key) const;
+    void layout(std::vector<std::size_t>& order, std::size_t k, std::size_t& rank) const;
+    static std::size_t climbRight(std::size_t k);
+    static std::size_t climbLeft(std::size_t k);
+
+    // How many slots fit in a cache line, i.e. how many levels down a
+    // prefetch of slot k * PREFETCH_STRIDE reaches (log2 of the stride).
+    static const std::size_t PREFETCH_STRIDE = sizeof(Key) >= 64 ? 1 : 64 / sizeof(Key);
+
+    // Index 0 of each array is unused so the children of k are 2k and 2k + 1
+    // and an index of 0 can stand for "not found".
+    std::vector<Key> keys_;
+    std::vector<Value> values_;
+    std::size_t size_;
+    Compare comp_;
+};
+
+/*
+----------------------------------------------------
+Begin implementations for the FrozenMap::iterator class.
+----------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<class Key, class Value, typename Compare>
+FrozenMap<Key, Value, Compare>::iterator::iterator() :
+    map_(nullptr), index_(0)
+{
+
+}
+
+/**
+* Explicit constructor for a slot of map; slot 0 is the end.
+*/
+template<class Key, class Value, typename Compare>
+FrozenMap<Key, Value, Compare>::iterator::iterator(const FrozenMap* map, std::size_t index) :
+    map_(map), index_(index)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator::reference
+FrozenMap<Key, Value, Compare>::iterator::operator*() const
+{
+    reference ref = {map_->keys_[index_], map_->values_[index_]};
+    return ref;
+}
+
+/**
+* Provides member access to the item, e.g. it->second.
+*/
+template<class Key, class Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator::pointer
+FrozenMap<Key, Value, Compare>::iterator::operator->() const
+{
+    pointer ptr = {**this};
+    return ptr;
+}
+
+/**
+* Iterators are equal when they are at the same slot; every end iterator
+* is at slot 0.
+*/
+template<class Key, class Value, typename Compare>
+bool FrozenMap<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<class Key, class Value, typename Compare>
+bool FrozenMap<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances to the in-order successor: the leftmost slot of the right
+* subtree, or else the first ancestor reached from its left side.
+*/
+template<class Key, class Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator&
+FrozenMap<Key, Value, Compare>::iterator::operator++()
+{
+    std::size_t n = map_->size_;
+    if(2 * index_ + 1 <= n)
+    {
+        index_ = 2 * index_ + 1;
+        while(2 * index_ <= n) index_ *= 2;
+    }
+    else
+    {
+        index_ = climbRight(index_);
+    }
+    return *this;
+}
+
+/**
+* Steps back to the in-order predecessor, mirroring operator++.
+*/
+template<class Key, class Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator&
+FrozenMap<Key, Value, Compare>::iterator::operator--()
+{
+    std::size_t n = map_->size_;
+    if(2 * index_ <= n)
+    {
+        index_ = 2 * index_;
+        while(2 * index_ + 1 <= n) index_ = 2 * index_ + 1;
+    }
+    else
+    {
+        index_ = climbLeft(index_);
+    }
+    return *this;
+}
+
+/*
+--------------------------------------------------
+End implementations for the FrozenMap::iterator class.
+--------------------------------------------------
+*/
+
+/*
+-------------------------------------------
+Begin implementations for the FrozenMap class.
+-------------------------------------------
+*/
+
+template<class Key, class Value, typename Compare>
+FrozenMap<Key, Value, Compare>::FrozenMap() :
+    size_(0), comp_()
+{
+
+}
+
+/**
+* Builds the snapshot from the items in [first, last), which must already
+* be sorted by comp with no duplicate keys, as any tree's begin()/end() is.
+*/
+template<class Key, class Value, typename Compare>
+template<typename InputIterator>
+FrozenMap<Key, Value, Compare>::FrozenMap(InputIterator first, InputIterator last, const Compare& comp) :
+    size_(0), comp_(comp)
+{
+    std::vector<std::pair<Key, Value> > sorted;
+    for(; first != last; ++first)
+    {
+        sorted.push_back(std::pair<Key, Value>(first->first, first->second));
+    }
+    size_ = sorted.size();
+
+    //an in-order walk over the implicit tree gives each slot its rank
+    std::vector<std::size_t> order(size_ + 1);
+    std::size_t rank = 0;
+    layout(order, 1, rank);
+
+    keys_.reserve(size_ + 1);
+    values_.reserve(size_ + 1);
+    //slot 0 is never read; fill it with a copy so Key and Value need no default constructor
+    if(size_ > 0)
+    {
+        keys_.push_back(sorted[0].first);
+        values_.push_back(sorted[0].second);
+    }
+    for(std::size_t k = 1; k <= size_; ++k)
+    {
+        keys_.push_back(std::move(sorted[order[k]].first));
+        values_.push_back(std::move(sorted[order[k]].second));
+    }
+}
+
+/**
+* Records in order[k] the rank of every slot in the subtree rooted at k.
+* Recursion is bounded by the height, which is log2(n).
+*/
+template<class Key, class Value, typename Compare>
+void FrozenMap<Key, Value, Compare>::layout(std::vector<std::size_t>& order, std::size_t k, std::size_t& rank) const
+{
+    if(k > size_) return;
+    layout(order, 2 * k, rank);
+    order[k] = rank++;
+    layout(order, 2 * k + 1, rank);
+}
+
+template<class Key, class Value, typename Compare>
+bool FrozenMap<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+template<class Key, class Value, typename Compare>
+std::size_t FrozenMap<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+* Undoes the trailing run of right turns that led to k along with the left
+* turn before it, giving the ancestor whose left subtree holds k, or 0.
+*/
+template<class Key, class Value, typename Compare>
+std::size_t FrozenMap<Key, Value, Compare>::climbRight(std::size_t k)
+{
+#if defined(__GNUC__)
+    return k >> __builtin_ffsll(static_cast<long long>(~k));
+#else
+    while(k & 1) k >>= 1;
+    return k >> 1;
+#endif
+}
+
+/**
+* Mirror of climbRight for a trailing run of left turns.
+*/
+template<class Key, class Value, typename Compare>
+std::size_t FrozenMap<Key, Value, Compare>::climbLeft(std::size_t k)
+{
+#if defined(__GNUC__)
+    return k >> __builtin_ffsll(static_cast<long long>(k));
+#else
+    while(k != 0 && !(k & 1)) k >>= 1;
+    return k >> 1;
+#endif
+}
+
+/**
+* Returns the slot of the first key not less than key, or 0 if there is
+* none. Each level either goes left (2k) or right (2k + 1) with the
+* comparison folded into the index. Once past the bottom, the last left
+* turn was taken at the answer, so the trailing right turns are undone.
+*/
+template<class Key, class Value, typename Compare>
+std::size_t FrozenMap<Key, Value, Compare>::lowerBoundIndex(const Key& key) const
+{
+    const Key* keys = keys_.data();
+    std::size_t k = 1;
+    while(k <= size_)
+    {
+#if defined(__GNUC__)
+        // the descendants of k a cache line's worth of levels down are
+        // contiguous; fetch them while this level is compared
+        __builtin_prefetch(keys + (k * PREFETCH_STRIDE < size_ ? k * PREFETCH_STRIDE : 0));
+#endif
+        k = 2 * k + static_cast<std::size_t>(comp_(keys[k], key));
+    }
+    return climbRight(k);
+}
+
+template<class Key, class Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator FrozenMap<Key, Value, Compare>::begin() const
+{
+    std::size_t k = size_ == 0 ? 0 : 1;
+    while(2 * k <= size_ && k != 0) k *= 2;
+    return iterator(this, k);
+}
+
+template<class Key, class Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator FrozenMap<Key, Value, Compare>::end() const
+{
+    return iterator(this, 0);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator FrozenMap<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(this, lowerBoundIndex(key));
+}
+
+/**
+* Returns an iterator to the item with the given key or end() if the key
+* is not in the map.
+*/
+template<class Key, class Value, typename Compare>
+typename FrozenMap<Key, Value, Compare>::iterator FrozenMap<Key, Value, Compare>::find(const Key& key) const
+{
+    std::size_t k = lowerBoundIndex(key);
+    if(k != 0 && comp_(key, keys_[k])) k = 0;
+    return iterator(this, k);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, typename Compare>
+Value const & FrozenMap<Key, Value, Compare>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return values_[it.index_];
+}
+
+/*
+-----------------------------------------
+End implementations for the FrozenMap class.
+-----------------------------------------
+*/
+
+#endif
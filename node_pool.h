@@ -0,0 +1,299 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+* A fixed-size block allocator used by the search trees for their nodes.
+* Blocks are carved out of large contiguous slabs, recycled through an
+* intrusive free list when a single node is removed, and handed back to
+* the system a whole slab at a time when the tree is cleared.
+*
+* The pool does not know what type lives in its blocks; whoever allocates a
+* block is responsible for constructing and destroying the object in it.
+* Blocks are aligned to alignof(std::max_align_t) unless another
+* alignment is requested: a larger one such as a cache line, or a smaller
+* one (at least a pointer's) to pack nodes that need no more.
+*
+* Trees that hand nodes to one another (see AVLTree::split and unionWith)
+* do so by letting pools hold on to each other's slabs: slabs are kept in
+* reference counted groups and a group is only freed once every pool that
+* adopted or shared it has been released.
+*/
+class NodePool
+{
+public:
+    explicit NodePool(std::size_t blockSize, std::size_t alignment = alignof(std::max_align_t));
+    ~NodePool();
+
+    void* allocate();
+    void deallocate(void* block);
+    void release();
+    void adopt(NodePool& other);
+    void share(const NodePool& other);
+
+    std::size_t blockSize() const;
+    std::size_t alignment() const;
+    std::size_t slabCount() const;
+
+private:
+    // Not copyable, the blocks handed out belong to exactly one pool.
+    NodePool(const NodePool& other);
+    NodePool& operator=(const NodePool& other);
+
+    void addSlab();
+
+    // A recycled block stores the link to the next free block in place.
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    // Header placed at the start of every slab so they can be freed together.
+    struct Slab
+    {
+        Slab* next;
+    };
+
+    // Slabs freed together once no pool refers to them any more.
+    struct SlabGroup
+    {
+        SlabGroup() : slabs(nullptr) {}
+        ~SlabGroup();
+        Slab* slabs;
+    };
+    typedef std::shared_ptr<SlabGroup> GroupRef;
+
+    void addGroup(const GroupRef& group);
+
+    static const std::size_t MIN_SLAB_BLOCKS = 32;
+    static const std::size_t MAX_SLAB_BLOCKS = 8192;
+
+    std::size_t alignment_;
+    std::size_t blockSize_;
+    std::size_t nextSlabBlocks_;
+    std::size_t slabCount_;
+    // Where this pool's own slabs go, created with the first one
+    GroupRef own_;
+    // Groups taken over from or shared with other pools
+    std::vector<GroupRef> others_;
+    FreeBlock* freeList_;
+    char* cursor_;
+    char* end_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the NodePool class.
+  ---------------------------------------------
+*/
+
+/**
+* Creates an empty pool handing out blocks of at least blockSize bytes,
+* each aligned to alignment (a power of two).
+* No memory is requested until the first allocation.
+*/
+inline NodePool::NodePool(std::size_t blockSize, std::size_t alignment) :
+    alignment_(alignment < alignof(FreeBlock) ? alignof(FreeBlock) : alignment),
+    blockSize_(0),
+    nextSlabBlocks_(MIN_SLAB_BLOCKS),
+    slabCount_(0),
+    freeList_(nullptr),
+    cursor_(nullptr),
+    end_(nullptr)
+{
+    if(blockSize < sizeof(FreeBlock)) blockSize = sizeof(FreeBlock);
+    // round up so every block in a slab is suitably aligned
+    blockSize_ = (blockSize + alignment_ - 1) / alignment_ * alignment_;
+}
+
+/**
+* Frees every slab. Objects still living in the pool are not destroyed.
+*/
+inline NodePool::~NodePool()
+{
+    release();
+}
+
+/**
+* Returns an uninitialized block, reusing a freed one when available.
+*/
+inline void* NodePool::allocate()
+{
+    if(freeList_ != nullptr)
+    {
+        FreeBlock* block = freeList_;
+        freeList_ = block->next;
+        return block;
+    }
+    if(cursor_ == end_)
+    {
+        addSlab();
+    }
+    void* block = cursor_;
+    cursor_ += blockSize_;
+    return block;
+}
+
+/**
+* Puts a block back on the free list so the next allocate() can reuse it.
+* The object in the block must already have been destroyed.
+*/
+inline void NodePool::deallocate(void* block)
+{
+    if(block == nullptr) return;
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    freed->next = freeList_;
+    freeList_ = freed;
+}
+
+/**
+* Returns every slab to the system at once, invalidating all blocks, except
+* for slabs some other pool still shares.
+*/
+inline void NodePool::release()
+{
+    own_.reset();
+    others_.clear();
+    nextSlabBlocks_ = MIN_SLAB_BLOCKS;
+    slabCount_ = 0;
+    freeList_ = nullptr;
+    cursor_ = nullptr;
+    end_ = nullptr;
+}
+
+/**
+* Takes over everything other holds, leaving it empty: its slabs now live
+* as long as this pool does and its free and unused blocks are handed out
+* by this pool. Used when a tree absorbs another tree's nodes. Both pools
+* must have the same block size and alignment.
+*/
+inline void NodePool::adopt(NodePool& other)
+{
+    if(&other == this) return;
+    if(other.own_) addGroup(other.own_);
+    for(std::size_t i = 0; i < other.others_.size(); ++i)
+    {
+        addGroup(other.others_[i]);
+    }
+
+    //the unused tail of other's current slab becomes free blocks here
+    for(char* block = other.cursor_; block != other.end_; block += blockSize_)
+    {
+        deallocate(block);
+    }
+    while(other.freeList_ != nullptr)
+    {
+        FreeBlock* block = other.freeList_;
+        other.freeList_ = block->next;
+        deallocate(block);
+    }
+
+    other.own_.reset();
+    other.others_.clear();
+    other.release();
+}
+
+/**
+* Keeps other's slabs alive for as long as this pool, without taking any
+* blocks from it. Used when a tree passes some of its nodes to another
+* tree, which may then outlive it.
+*/
+inline void NodePool::share(const NodePool& other)
+{
+    if(&other == this) return;
+    if(other.own_) addGroup(other.own_);
+    for(std::size_t i = 0; i < other.others_.size(); ++i)
+    {
+        addGroup(other.others_[i]);
+    }
+}
+
+inline void NodePool::addGroup(const GroupRef& group)
+{
+    if(group == own_) return;
+    for(std::size_t i = 0; i < others_.size(); ++i)
+    {
+        if(others_[i] == group) return;
+    }
+    others_.push_back(group);
+}
+
+/**
+* Frees the group's slabs once the last pool holding it lets go.
+*/
+inline NodePool::SlabGroup::~SlabGroup()
+{
+    while(slabs != nullptr)
+    {
+        Slab* next = slabs->next;
+        ::operator delete(slabs);
+        slabs = next;
+    }
+}
+
+/**
+* A getter for the (aligned) size of each block.
+*/
+inline std::size_t NodePool::blockSize() const
+{
+    return blockSize_;
+}
+
+inline std::size_t NodePool::alignment() const
+{
+    return alignment_;
+}
+
+/**
+* A getter for the number of slabs this pool has allocated itself.
+*/
+inline std::size_t NodePool::slabCount() const
+{
+    return slabCount_;
+}
+
+/**
+* Requests a new slab from the system. Slabs double in size up to
+* MAX_SLAB_BLOCKS so small trees stay small and large ones make few calls.
+*/
+inline void NodePool::addSlab()
+{
+    // operator new only guarantees max_align_t, so over-allocate enough
+    // to slide the first block up to the requested alignment
+    char* raw = static_cast<char*>(::operator new(sizeof(Slab) + alignment_ + nextSlabBlocks_ * blockSize_));
+
+    if(!own_)
+    {
+        try
+        {
+            own_ = std::make_shared<SlabGroup>();
+        }
+        catch(...)
+        {
+            ::operator delete(raw);
+            throw;
+        }
+    }
+    Slab* slab = reinterpret_cast<Slab*>(raw);
+    slab->next = own_->slabs;
+    own_->slabs = slab;
+    ++slabCount_;
+
+    std::size_t first = reinterpret_cast<std::size_t>(raw + sizeof(Slab));
+    first = (first + alignment_ - 1) / alignment_ * alignment_;
+    cursor_ = reinterpret_cast<char*>(first);
+    end_ = cursor_ + nextSlabBlocks_ * blockSize_;
+    if(nextSlabBlocks_ < MAX_SLAB_BLOCKS) nextSlabBlocks_ *= 2;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the NodePool class.
+  -------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,565 @@
+#ifndef PERSISTENT_AVL_H
+#define PERSISTENT_AVL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+* An AVL tree whose nodes never change once built. insert and remove copy
+* only the nodes on the path from the root to the change (O(log n) of
+* them) and share every other subtree with the previous version, so
+* snapshot() is just another reference to the current root: O(1), and the
+* snapshot stays the same however the tree is changed afterwards.
+*
+* Nodes are reference counted; a node is freed when the last version that
+* can reach it goes away. The counts are atomic, so snapshots may be handed
+* to and dropped by other threads, though each PersistentAVLTree object is
+* itself only safe to use from one thread at a time.
+*
+* The balancing rules are AVLTree's, rewritten in terms of building new
+* nodes: nodes here have no parent pointers (a shared node can have many
+* parents) and store their height instead of a balance factor.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class PersistentAVLTree
+{
+protected:
+    struct Node
+    {
+        Node(const Key& key, const Value& value, Node* left, Node* right);
+
+        std::pair<const Key, Value> item;
+        Node* left;
+        Node* right;
+        std::size_t size;
+        int8_t height;
+        std::atomic<std::size_t> refs;
+    };
+
+public:
+    PersistentAVLTree();
+    explicit PersistentAVLTree(const Compare& comp);
+    PersistentAVLTree(const PersistentAVLTree& other);
+    PersistentAVLTree(PersistentAVLTree&& other);
+    PersistentAVLTree& operator=(const PersistentAVLTree& other);
+    PersistentAVLTree& operator=(PersistentAVLTree&& other);
+    ~PersistentAVLTree();
+
+    PersistentAVLTree snapshot() const;
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+    static std::size_t liveNodes();
+
+    /**
+    * An iterator over one version of the tree, in key order. Since nodes
+    * know nothing of their parents it keeps the path down from the root.
+    * It is valid for as long as some version holding its nodes is alive.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    private:
+        friend class PersistentAVLTree<Key, Value, Compare>;
+        void pushLeft(const Node* n);
+        // the current node last, below it every ancestor still to be visited
+        std::vector<const Node*> path_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    static Node* retain(Node* n);
+    static void release(Node* n);
+    static int height(const Node* n);
+    static std::size_t subtreeSize(const Node* n);
+    static Node* balance(const Key& key, const Value& value, Node* left, Node* right);
+    Node* insertHelper(Node* n, const Key& key, const Value& value) const;
+    Node* removeHelper(Node* n, const Key& key, bool& removed) const;
+    static Node* removeSmallest(Node* n);
+
+    static std::atomic<std::size_t> liveNodes_;
+
+    Node* root_;
+    Compare comp_;
+};
+
+template<class Key, class Value, class Compare>
+std::atomic<std::size_t> PersistentAVLTree<Key, Value, Compare>::liveNodes_(0);
+
+/**
+* Builds a node over left and right, taking over one reference to each.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::Node::Node(const Key& key, const Value& value, Node* left, Node* right) :
+    item(key, value),
+    left(left),
+    right(right),
+    size(1 + subtreeSize(left) + subtreeSize(right)),
+    height(static_cast<int8_t>(1 + std::max(PersistentAVLTree::height(left), PersistentAVLTree::height(right)))),
+    refs(1)
+{
+    liveNodes_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+----------------------------------------------------
+Begin implementations for the PersistentAVLTree::iterator class.
+----------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::iterator::iterator()
+{
+
+}
+
+template<class Key, class Value, class Compare>
+const std::pair<const Key, Value>& PersistentAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return path_.back()->item;
+}
+
+template<class Key, class Value, class Compare>
+const std::pair<const Key, Value>* PersistentAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(path_.back()->item);
+}
+
+/**
+* Iterators are equal when they are at the same node; all end iterators
+* have an empty path.
+*/
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    if(path_.empty() || rhs.path_.empty()) return path_.empty() && rhs.path_.empty();
+    return path_.back() == rhs.path_.back();
+}
+
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Pushes n and its chain of left children, ending at the smallest node
+* of n's subtree.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::iterator::pushLeft(const Node* n)
+{
+    while(n != nullptr)
+    {
+        path_.push_back(n);
+        n = n->left;
+    }
+}
+
+/**
+* Advances to the smallest node of the right subtree if there is one,
+* otherwise to the nearest ancestor still on the path.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator&
+PersistentAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    const Node* current = path_.back();
+    path_.pop_back();
+    pushLeft(current->right);
+    return *this;
+}
+
+/*
+--------------------------------------------------
+End implementations for the PersistentAVLTree::iterator class.
+--------------------------------------------------
+*/
+
+/*
+-------------------------------------------
+Begin implementations for the PersistentAVLTree class.
+-------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree() :
+    root_(nullptr), comp_()
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by the given comparator.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const Compare& comp) :
+    root_(nullptr), comp_(comp)
+{
+
+}
+
+/**
+* Copying shares every node, so it costs O(1) whatever the size.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const PersistentAVLTree& other) :
+    root_(retain(other.root_)), comp_(other.comp_)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(PersistentAVLTree&& other) :
+    root_(other.root_), comp_(other.comp_)
+{
+    other.root_ = nullptr;
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(const PersistentAVLTree& other)
+{
+    Node* root = retain(other.root_);
+    release(root_);
+    root_ = root;
+    comp_ = other.comp_;
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(PersistentAVLTree&& other)
+{
+    if(this != &other)
+    {
+        release(root_);
+        root_ = other.root_;
+        comp_ = other.comp_;
+        other.root_ = nullptr;
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::~PersistentAVLTree()
+{
+    release(root_);
+}
+
+/**
+* Returns a version of the tree that later changes to this one will not
+* affect, in O(1).
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare> PersistentAVLTree<Key, Value, Compare>::snapshot() const
+{
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::clear()
+{
+    release(root_);
+    root_ = nullptr;
+}
+
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::empty() const
+{
+    return root_ == nullptr;
+}
+
+template<class Key, class Value, class Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::size() const
+{
+    return subtreeSize(root_);
+}
+
+/**
+* Returns how many nodes every tree of this type holds between them, each
+* shared node counted once; used to measure how much versions share.
+*/
+template<class Key, class Value, class Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::liveNodes()
+{
+    return liveNodes_.load(std::memory_order_relaxed);
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::retain(Node* n)
+{
+    if(n != nullptr) n->refs.fetch_add(1, std::memory_order_relaxed);
+    return n;
+}
+
+/**
+* Drops one reference to n, freeing it and releasing its children when it
+* was the last. Right children are handled in the loop so freeing a whole
+* tree only recurses as deep as its height.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::release(Node* n)
+{
+    while(n != nullptr && n->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        Node* right = n->right;
+        release(n->left);
+        delete n;
+        liveNodes_.fetch_sub(1, std::memory_order_relaxed);
+        n = right;
+    }
+}
+
+template<class Key, class Value, class Compare>
+int PersistentAVLTree<Key, Value, Compare>::height(const Node* n)
+{
+    return (n == nullptr) ? 0 : n->height;
+}
+
+template<class Key, class Value, class Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::subtreeSize(const Node* n)
+{
+    return (n == nullptr) ? 0 : n->size;
+}
+
+/**
+* Builds the node (key, value, left, right), taking over the references to
+* left and right, rotating as AVLTree does if their heights differ by two.
+* A rotation copies the child it lifts and the child's grandchild in a
+* double rotation, and drops the reference to the original.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::balance(const Key& key, const Value& value, Node* left, Node* right)
+{
+    if(height(left) > height(right) + 1)
+    {
+        Node* result;
+        if(height(left->left) >= height(left->right))
+        {
+            //zig-zig, rotate right
+            Node* lowered = new Node(key, value, retain(left->right), right);
+            result = new Node(left->item.first, left->item.second, retain(left->left), lowered);
+        }
+        else
+        {
+            //zig-zag, rotate left then right
+            Node* pivot = left->right;
+            Node* newLeft = new Node(left->item.first, left->item.second, retain(left->left), retain(pivot->left));
+            Node* newRight = new Node(key, value, retain(pivot->right), right);
+            result = new Node(pivot->item.first, pivot->item.second, newLeft, newRight);
+        }
+        release(left);
+        return result;
+    }
+    if(height(right) > height(left) + 1)
+    {
+        Node* result;
+        if(height(right->right) >= height(right->left))
+        {
+            //zig-zig, rotate left
+            Node* lowered = new Node(key, value, left, retain(right->left));
+            result = new Node(right->item.first, right->item.second, lowered, retain(right->right));
+        }
+        else
+        {
+            //zig-zag, rotate right then left
+            Node* pivot = right->left;
+            Node* newLeft = new Node(key, value, left, retain(pivot->left));
+            Node* newRight = new Node(right->item.first, right->item.second, retain(pivot->right), retain(right->right));
+            result = new Node(pivot->item.first, pivot->item.second, newLeft, newRight);
+        }
+        release(right);
+        return result;
+    }
+    return new Node(key, value, left, right);
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+* Earlier snapshots keep the old value.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Node* root = insertHelper(root_, keyValuePair.first, keyValuePair.second);
+    release(root_);
+    root_ = root;
+}
+
+/**
+* Returns a new version of n's subtree holding key, copying the path to it.
+* Recursion is bounded by the height.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::insertHelper(Node* n, const Key& key, const Value& value) const
+{
+    if(n == nullptr)
+    {
+        return new Node(key, value, nullptr, nullptr);
+    }
+    if(comp_(key, n->item.first))
+    {
+        return balance(n->item.first, n->item.second, insertHelper(n->left, key, value), retain(n->right));
+    }
+    if(comp_(n->item.first, key))
+    {
+        return balance(n->item.first, n->item.second, retain(n->left), insertHelper(n->right, key, value));
+    }
+    return new Node(n->item.first, value, retain(n->left), retain(n->right));
+}
+
+/**
+* Removes the item with the given key, if present. Earlier snapshots still
+* hold it.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    bool removed = false;
+    Node* root = removeHelper(root_, key, removed);
+    release(root_);
+    root_ = root;
+}
+
+/**
+* Returns a new reference to n's subtree without key. If key is not there
+* nothing is copied and the result is n itself.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::removeHelper(Node* n, const Key& key, bool& removed) const
+{
+    if(n == nullptr) return nullptr;
+    if(comp_(key, n->item.first))
+    {
+        Node* left = removeHelper(n->left, key, removed);
+        if(!removed)
+        {
+            release(left);
+            return retain(n);
+        }
+        return balance(n->item.first, n->item.second, left, retain(n->right));
+    }
+    if(comp_(n->item.first, key))
+    {
+        Node* right = removeHelper(n->right, key, removed);
+        if(!removed)
+        {
+            release(right);
+            return retain(n);
+        }
+        return balance(n->item.first, n->item.second, retain(n->left), right);
+    }
+
+    removed = true;
+    if(n->left == nullptr) return retain(n->right);
+    if(n->right == nullptr) return retain(n->left);
+    //two children, the smallest item on the right takes n's place
+    const Node* smallest = n->right;
+    while(smallest->left != nullptr) smallest = smallest->left;
+    return balance(smallest->item.first, smallest->item.second, retain(n->left), removeSmallest(n->right));
+}
+
+/**
+* Returns a new reference to n's subtree without its smallest node.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::removeSmallest(Node* n)
+{
+    if(n->left == nullptr) return retain(n->right);
+    return balance(n->item.first, n->item.second, removeSmallest(n->left), retain(n->right));
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::begin() const
+{
+    iterator it;
+    it.pushLeft(root_);
+    return it;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key or end() if the key
+* is not in the tree. Nodes where the search turns left are kept on the
+* iterator's path since they come after the result.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it;
+    const Node* current = root_;
+    while(current != nullptr)
+    {
+        if(comp_(key, current->item.first))
+        {
+            it.path_.push_back(current);
+            current = current->left;
+        }
+        else if(comp_(current->item.first, key))
+        {
+            current = current->right;
+        }
+        else
+        {
+            it.path_.push_back(current);
+            return it;
+        }
+    }
+    return end();
+}
+
+/**
+ * @precondition The key exists in the tree
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value const & PersistentAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/*
+-----------------------------------------
+End implementations for the PersistentAVLTree class.
+-----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,449 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "bst.h"
+
+/**
+* A node for a red black tree, which adds its color to Node.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    // New nodes start out red, as an insert needs them.
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    RBNode(RBNode<Key, Value>* parent, ItemBuilder<Key, Value>& item);
+    ~RBNode();
+
+    bool isRed() const;
+    void setRed(bool red);
+
+    // Getters for parent, left, and right. These hide the Node versions since they
+    // return pointers to RBNodes - not plain Nodes.
+    RBNode<Key, Value>* getParent() const;
+    RBNode<Key, Value>* getLeft() const;
+    RBNode<Key, Value>* getRight() const;
+
+protected:
+    bool red_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent) :
+    Node<Key, Value>(key, value, parent), red_(true)
+{
+
+}
+
+/**
+* A constructor having item build the key/value pair, see ItemBuilder.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(RBNode<Key, Value>* parent, ItemBuilder<Key, Value>& item) :
+    Node<Key, Value>(parent, item), red_(true)
+{
+
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+
+}
+
+template<class Key, class Value>
+bool RBNode<Key, Value>::isRed() const
+{
+    return red_;
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::setRed(bool red)
+{
+    red_ = red;
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A red black tree. It is balanced more loosely than an AVLTree (up to
+* 2 log2(n) deep instead of 1.44 log2(n)), but restoring the balance
+* after an update takes at most two rotations for an insert and three for
+* a remove, the rest of the work being recoloring. That suits maps that
+* see as many writes as reads.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class RedBlackTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator iterator;
+
+    RedBlackTree();
+    explicit RedBlackTree(const Compare& comp);
+    template<typename InputIterator>
+    RedBlackTree(InputIterator first, InputIterator last, const Compare& comp = Compare());
+    template<typename InputIterator>
+    RedBlackTree(ParallelTag, InputIterator first, InputIterator last, const Compare& comp = Compare());
+    virtual void insert(const std::pair<const Key, Value>& keyValuePair);
+    virtual void insert(std::pair<const Key, Value>&& keyValuePair);
+    virtual void remove(const Key& key);
+
+protected:
+    virtual void linkNode(Node<Key, Value>* n, Node<Key, Value>* parent, bool goRight);
+    virtual Node<Key, Value>* makeNode(Node<Key, Value>* parent, ItemBuilder<Key, Value>& item);
+    void nodeSwap(RBNode<Key,Value>* n1, RBNode<Key,Value>* n2);
+    void insertFix(RBNode<Key,Value>* n);
+    void removeFix(RBNode<Key,Value>* n, RBNode<Key,Value>* p);
+    void rotateAt(RBNode<Key,Value>* n, bool right);
+    RBNode<Key,Value>* root() const;
+    static bool isRed(const RBNode<Key,Value>* n);
+    static int blackLevels(std::size_t size);
+    virtual Node<Key,Value>* buildSubtree(
+        std::vector<std::pair<Key, Value> >& items, std::size_t lo, std::size_t hi,
+        Node<Key,Value>* parent, int& height, NodePool& pool, bool parallel);
+};
+
+/*
+--------------------------------------------------------------
+Begin implementations for the RedBlackTree class.
+--------------------------------------------------------------
+*/
+
+/**
+* Default constructor, which sizes the node pool for RBNodes.
+*/
+template<class Key, class Value, typename Compare>
+RedBlackTree<Key, Value, Compare>::RedBlackTree() :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(RBNode<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<RBNode<Key, Value> >,
+        Compare())
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by the given comparator.
+*/
+template<class Key, class Value, typename Compare>
+RedBlackTree<Key, Value, Compare>::RedBlackTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(RBNode<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<RBNode<Key, Value> >,
+        comp)
+{
+
+}
+
+/**
+* Range constructor which builds a balanced tree from the given items.
+*/
+template<class Key, class Value, typename Compare>
+template<typename InputIterator>
+RedBlackTree<Key, Value, Compare>::RedBlackTree(InputIterator first, InputIterator last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(RBNode<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<RBNode<Key, Value> >,
+        comp)
+{
+    this->bulkLoad(first, last);
+}
+
+/**
+* Range constructor which sorts and builds in parallel, see
+* BinarySearchTree::parallelBulkLoad.
+*/
+template<class Key, class Value, typename Compare>
+template<typename InputIterator>
+RedBlackTree<Key, Value, Compare>::RedBlackTree(ParallelTag, InputIterator first, InputIterator last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(RBNode<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<RBNode<Key, Value> >,
+        comp)
+{
+    this->parallelBulkLoad(first, last);
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+*/
+template<class Key, class Value, typename Compare>
+void RedBlackTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    this->insert_or_assign(keyValuePair.first, keyValuePair.second);
+}
+
+/**
+* Same as above, but moves the value out of keyValuePair instead of copying it.
+*/
+template<class Key, class Value, typename Compare>
+void RedBlackTree<Key, Value, Compare>::insert(std::pair<const Key, Value>&& keyValuePair)
+{
+    this->insert_or_assign(keyValuePair.first, std::move(keyValuePair.second));
+}
+
+template<class Key, class Value, typename Compare>
+RBNode<Key,Value>* RedBlackTree<Key, Value, Compare>::root() const
+{
+    return static_cast<RBNode<Key,Value>*>(this->root_);
+}
+
+/**
+* Null children count as black.
+*/
+template<class Key, class Value, typename Compare>
+bool RedBlackTree<Key, Value, Compare>::isRed(const RBNode<Key,Value>* n)
+{
+    return n != nullptr && n -> isRed();
+}
+
+/**
+* Rotates at n, lifting its left child if right is true and its right
+* child otherwise, and moves root_ along if n was the root.
+*/
+template<class Key, class Value, typename Compare>
+void RedBlackTree<Key, Value, Compare>::rotateAt(RBNode<Key,Value>* n, bool right)
+{
+    bool top = (n == this->root_);
+    if(right) BinarySearchTree<Key, Value, Compare>::rotateRight(n);
+    else BinarySearchTree<Key, Value, Compare>::rotateLeft(n);
+    if(top) this->root_ = n -> getParent();
+}
+
+/**
+* Makes every new node an RBNode, whichever insert made it.
+*/
+template<class Key, class Value, typename Compare>
+Node<Key, Value>* RedBlackTree<Key, Value, Compare>::makeNode(Node<Key, Value>* parent, ItemBuilder<Key, Value>& item)
+{
+    return this->template createNode<RBNode<Key, Value> >(static_cast<RBNode<Key, Value>*>(parent), item);
+}
+
+/**
+* Links the new red leaf in and restores the colors.
+*/
+template<class Key, class Value, typename Compare>
+void RedBlackTree<Key, Value, Compare>::linkNode(Node<Key, Value>* n, Node<Key, Value>* parent, bool goRight)
+{
+    BinarySearchTree<Key, Value, Compare>::linkNode(n, parent, goRight);
+    insertFix(static_cast<RBNode<Key,Value>*>(n));
+}
+
+/**
+* Fixes a red node n with a red parent. While the uncle is red too the
+* problem is pushed two levels up by recoloring alone; otherwise one or
+* two rotations at the grandparent end it.
+*/
+template<class Key, class Value, typename Compare>
+void RedBlackTree<Key, Value, Compare>::insertFix(RBNode<Key,Value>* n)
+{
+    RBNode<Key,Value>* p = n -> getParent();
+    while(isRed(p))
+    {
+        TREE_STAT(TreeCounters::add(this->counters_.insertFixSteps));
+        //a red parent is never the root, so g exists
+        RBNode<Key,Value>* g = p -> getParent();
+        bool pLeft = (p == g -> getLeft());
+        RBNode<Key,Value>* uncle = pLeft ? g -> getRight() : g -> getLeft();
+        if(isRed(uncle))
+        {
+            p -> setRed(false);
+            uncle -> setRed(false);
+            g -> setRed(true);
+            n = g;
+            p = n -> getParent();
+            continue;
+        }
+        //n on the inside of g, rotate it to the outside first
+        if(pLeft != (n == p -> getLeft()))
+        {
+            rotateAt(p, !pLeft);
+            n = p;
+            p = n -> getParent();
+        }
+        p -> setRed(false);
+        g -> setRed(true);
+        rotateAt(g, pLeft);
+        break;
+    }
+    root() -> setRed(false);
+}
+
+/**
+* Removes the item with the given key, if present. A node with two
+* children first trades places with its predecessor, as in AVLTree.
+*/
+template<class Key, class Value, typename Compare>
+void RedBlackTree<Key, Value, Compare>::remove(const Key& key)
+{
+    RBNode<Key,Value>* current = static_cast<RBNode<Key,Value>*>(this->internalFind(key));
+    if(current == nullptr) return;
+
+    //2 children
+    if(current -> getLeft() != nullptr && current -> getRight() != nullptr)
+    {
+        nodeSwap(current, static_cast<RBNode<Key,Value>*>(this->predecessor(current)));
+    }
+
+    //current now has at most one child, which takes its place
+    RBNode<Key,Value>* p = current -> getParent();
+    RBNode<Key,Value>* c = (current -> getLeft() != nullptr) ? current -> getLeft() : current -> getRight();
+    if(c != nullptr) c -> setParent(p);
+    if(p == nullptr) this->root_ = c;
+    else if(current == p -> getLeft()) p -> setLeft(c);
+    else p -> setRight(c);
+    this->updatePathSizes(p, -1);
+
+    bool removedBlack = !current -> isRed();
+    this->destroyNode(current);
+    if(removedBlack) removeFix(c, p);
+}
+
+/**
+* n (possibly null) below p is short one black node compared to its
+* sibling's side. A red n is simply painted black. Otherwise, while the
+* sibling and both its children are black, painting the sibling red moves
+* the shortage up to p; in every other case at most three rotations settle
+* it where it is.
+*/
+template<class Key, class Value, typename Compare>
+void RedBlackTree<Key, Value, Compare>::removeFix(RBNode<Key,Value>* n, RBNode<Key,Value>* p)
+{
+    while(p != nullptr && !isRed(n))
+    {
+        TREE_STAT(TreeCounters::add(this->counters_.removeFixSteps));
+        bool nLeft = (n == p -> getLeft());
+        //the sibling's side has at least one black node, so it exists
+        RBNode<Key,Value>* s = nLeft ? p -> getRight() : p -> getLeft();
+        if(s -> isRed())
+        {
+            s -> setRed(false);
+            p -> setRed(true);
+            rotateAt(p, !nLeft);
+            s = nLeft ? p -> getRight() : p -> getLeft();
+        }
+        RBNode<Key,Value>* near = nLeft ? s -> getLeft() : s -> getRight();
+        RBNode<Key,Value>* far = nLeft ? s -> getRight() : s -> getLeft();
+        if(!isRed(near) && !isRed(far))
+        {
+            s -> setRed(true);
+            n = p;
+            p = n -> getParent();
+            continue;
+        }
+        if(!isRed(far))
+        {
+            near -> setRed(false);
+            s -> setRed(true);
+            rotateAt(s, nLeft);
+            far = s;
+            s = near;
+        }
+        s -> setRed(p -> isRed());
+        p -> setRed(false);
+        far -> setRed(false);
+        rotateAt(p, !nLeft);
+        return;
+    }
+    if(n != nullptr) n -> setRed(false);
+}
+
+/**
+* Swaps the positions of two nodes; colors belong to the positions, so
+* they are swapped back.
+*/
+template<class Key, class Value, typename Compare>
+void RedBlackTree<Key, Value, Compare>::nodeSwap(RBNode<Key,Value>* n1, RBNode<Key,Value>* n2)
+{
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
+    bool tempRed = n1 -> isRed();
+    n1 -> setRed(n2 -> isRed());
+    n2 -> setRed(tempRed);
+}
+
+/**
+* floor(log2(size + 1)): the number of full levels in a subtree of size
+* nodes built by buildSubtree, which is the number of black nodes on each
+* of its paths.
+*/
+template<class Key, class Value, typename Compare>
+int RedBlackTree<Key, Value, Compare>::blackLevels(std::size_t size)
+{
+    int levels = 0;
+    for(++size; size > 1; size >>= 1) ++levels;
+    return levels;
+}
+
+/**
+* Same as the base version but creates RBNodes. A node is black unless
+* its subtree has as many full levels as its parent's, which only happens
+* to a perfect subtree next to a deeper one; making it red keeps every
+* path's black count equal to the number of full levels.
+*/
+template<class Key, class Value, typename Compare>
+Node<Key,Value>* RedBlackTree<Key, Value, Compare>::buildSubtree(
+    std::vector<std::pair<Key, Value> >& items, std::size_t lo, std::size_t hi,
+    Node<Key,Value>* parent, int& height, NodePool& pool, bool parallel)
+{
+    if(lo >= hi)
+    {
+        height = 0;
+        return nullptr;
+    }
+    std::size_t mid = lo + (hi - lo) / 2;
+    RBNode<Key,Value>* n = this->template createNodeIn<RBNode<Key,Value> >(
+        pool, items[mid].first, items[mid].second, static_cast<RBNode<Key,Value>*>(parent));
+    n -> setRed(false);
+    int leftHeight, rightHeight;
+    this->buildChildren(items, lo, mid, hi, n, leftHeight, rightHeight, pool, parallel);
+    n -> setSize(hi - lo);
+
+    int levels = blackLevels(hi - lo);
+    if(n -> getLeft() != nullptr && blackLevels(n -> getLeft() -> getSize()) == levels)
+    {
+        n -> getLeft() -> setRed(true);
+    }
+    if(n -> getRight() != nullptr && blackLevels(n -> getRight() -> getSize()) == levels)
+    {
+        n -> getRight() -> setRed(true);
+    }
+    height = std::max(leftHeight, rightHeight) + 1;
+    return n;
+}
+
+/*
+--------------------------------------------------------------
+End implementations for the RedBlackTree class.
+--------------------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef SCAPEGOAT_TREE_H
+#define SCAPEGOAT_TREE_H
+
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "bst.h"
+
+/**
+* A scapegoat tree: a balanced search tree whose nodes carry no balance
+* information at all. Inserts go in as plain leaves; only when one lands
+* deeper than log base 1/alpha of the size does the tree look up the path
+* for the lowest ancestor with one child holding more than alpha of its
+* nodes (the scapegoat, found from the subtree sizes every Node already
+* keeps) and rebuild that subtree perfectly balanced in linear time. Once
+* removes have shrunk the tree below alpha of its largest size the whole
+* tree is rebuilt. Searches are O(log n) worst case and updates O(log n)
+* amortized.
+*
+* Rebuilding relinks the existing nodes rather than copying the items, so
+* iterators stay valid. Nodes are plain Nodes packed to their own
+* alignment, 40 bytes for int keys and values where an AVLNode takes 48.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class ScapegoatTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    ScapegoatTree();
+    explicit ScapegoatTree(const Compare& comp);
+    template<typename InputIterator>
+    ScapegoatTree(InputIterator first, InputIterator last, const Compare& comp = Compare());
+    template<typename InputIterator>
+    ScapegoatTree(ParallelTag, InputIterator first, InputIterator last, const Compare& comp = Compare());
+    virtual void remove(const Key& key);
+    virtual void clear();
+
+    static std::size_t nodeBytes();
+
+protected:
+    virtual void linkNode(Node<Key, Value>* n, Node<Key, Value>* parent, bool goRight);
+    void rebuild(Node<Key, Value>* top);
+    static Node<Key, Value>* relink(std::vector<Node<Key, Value>*>& nodes, std::size_t lo, std::size_t hi,
+                                    Node<Key, Value>* parent);
+    static int depthLimit(std::size_t size);
+
+    // alpha = ALPHA_NUM / ALPHA_DEN; lower rebuilds more often but keeps
+    // the tree shallower. 0.6 keeps 100k keys within 23 levels (an AVLTree
+    // takes 17) where 0.7 let them reach 33, for about 1.4x the insert time.
+    static const std::size_t ALPHA_NUM = 6;
+    static const std::size_t ALPHA_DEN = 10;
+
+    // The largest size since the whole tree was last rebuilt
+    std::size_t maxSize_;
+};
+
+/*
+--------------------------------------------------------------
+Begin implementations for the ScapegoatTree class.
+--------------------------------------------------------------
+*/
+
+/**
+* Default constructor, which packs the node pool to Node's own alignment.
+*/
+template<class Key, class Value, typename Compare>
+ScapegoatTree<Key, Value, Compare>::ScapegoatTree() :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(Node<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<Node<Key, Value> >,
+        Compare(), alignof(Node<Key, Value>)),
+    maxSize_(0)
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by the given comparator.
+*/
+template<class Key, class Value, typename Compare>
+ScapegoatTree<Key, Value, Compare>::ScapegoatTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(Node<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<Node<Key, Value> >,
+        comp, alignof(Node<Key, Value>)),
+    maxSize_(0)
+{
+
+}
+
+/**
+* Range constructor which builds a balanced tree from the given items.
+*/
+template<class Key, class Value, typename Compare>
+template<typename InputIterator>
+ScapegoatTree<Key, Value, Compare>::ScapegoatTree(InputIterator first, InputIterator last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(Node<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<Node<Key, Value> >,
+        comp, alignof(Node<Key, Value>)),
+    maxSize_(0)
+{
+    this->bulkLoad(first, last);
+}
+
+/**
+* Range constructor which sorts and builds in parallel, see
+* BinarySearchTree::parallelBulkLoad.
+*/
+template<class Key, class Value, typename Compare>
+template<typename InputIterator>
+ScapegoatTree<Key, Value, Compare>::ScapegoatTree(ParallelTag, InputIterator first, InputIterator last,
+                                                  const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(
+        sizeof(Node<Key, Value>), &BinarySearchTree<Key, Value, Compare>::template destroyAs<Node<Key, Value> >,
+        comp, alignof(Node<Key, Value>)),
+    maxSize_(0)
+{
+    this->parallelBulkLoad(first, last);
+}
+
+/**
+* The pool memory each node takes.
+*/
+template<class Key, class Value, typename Compare>
+std::size_t ScapegoatTree<Key, Value, Compare>::nodeBytes()
+{
+    return NodePool(sizeof(Node<Key, Value>), alignof(Node<Key, Value>)).blockSize();
+}
+
+/**
+* floor(log base 1/alpha of size), the deepest an insert may put a node
+* without a rebuild.
+*/
+template<class Key, class Value, typename Compare>
+int ScapegoatTree<Key, Value, Compare>::depthLimit(std::size_t size)
+{
+    static const double logInverseAlpha = std::log(static_cast<double>(ALPHA_DEN) / ALPHA_NUM);
+    return static_cast<int>(std::log(static_cast<double>(size)) / logInverseAlpha);
+}
+
+/**
+* Links the new leaf in and, if it went too deep, rebuilds the subtree of
+* the lowest ancestor that is out of balance. One walk up to the root both
+* measures the depth and finds that ancestor.
+*/
+template<class Key, class Value, typename Compare>
+void ScapegoatTree<Key, Value, Compare>::linkNode(Node<Key, Value>* n, Node<Key, Value>* parent, bool goRight)
+{
+    BinarySearchTree<Key, Value, Compare>::linkNode(n, parent, goRight);
+    std::size_t size = this->size();
+    if(size > maxSize_) maxSize_ = size;
+
+    int depth = 0;
+    Node<Key, Value>* scapegoat = nullptr;
+    Node<Key, Value>* child = n;
+    for(Node<Key, Value>* w = parent; w != nullptr; child = w, w = w -> getParent())
+    {
+        ++depth;
+        if(scapegoat == nullptr && child -> getSize() * ALPHA_DEN > w -> getSize() * ALPHA_NUM)
+        {
+            scapegoat = w;
+        }
+    }
+    //a node deeper than the limit always has an unbalanced ancestor
+    if(depth > depthLimit(size) && scapegoat != nullptr)
+    {
+        rebuild(scapegoat);
+    }
+}
+
+/**
+* Empties the tree and forgets its largest size, which would otherwise
+* make the first removes after a refill rebuild the whole tree.
+*/
+template<class Key, class Value, typename Compare>
+void ScapegoatTree<Key, Value, Compare>::clear()
+{
+    BinarySearchTree<Key, Value, Compare>::clear();
+    maxSize_ = 0;
+}
+
+/**
+* Removes the item as BinarySearchTree does, then rebuilds the whole tree
+* if it has shrunk below alpha of its largest size, since removes alone
+* never trigger a rebuild below the root.
+*/
+template<class Key, class Value, typename Compare>
+void ScapegoatTree<Key, Value, Compare>::remove(const Key& key)
+{
+    std::size_t before = this->size();
+    //bulkLoad does not go through linkNode, so maxSize_ may be behind
+    if(before > maxSize_) maxSize_ = before;
+    BinarySearchTree<Key, Value, Compare>::remove(key);
+
+    std::size_t size = this->size();
+    if(size < before && size * ALPHA_DEN < maxSize_ * ALPHA_NUM)
+    {
+        if(this->root_ != nullptr) rebuild(this->root_);
+        maxSize_ = size;
+    }
+}
+
+/**
+* Flattens top's subtree into an array of its nodes in order and links
+* them back up as a perfectly balanced subtree in the same place.
+*/
+template<class Key, class Value, typename Compare>
+void ScapegoatTree<Key, Value, Compare>::rebuild(Node<Key, Value>* top)
+{
+    std::size_t count = top -> getSize();
+    Node<Key, Value>* above = top -> getParent();
+    bool wasLeft = (above != nullptr && top == above -> getLeft());
+
+    std::vector<Node<Key, Value>*> nodes;
+    nodes.reserve(count);
+    Node<Key, Value>* current = top;
+    while(current -> getLeft() != nullptr) current = current -> getLeft();
+    //counting stops the walk before successor climbs out of the subtree
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        nodes.push_back(current);
+        if(i + 1 < count) current = BinarySearchTree<Key, Value, Compare>::successor(current, this->counters());
+    }
+
+    Node<Key, Value>* built = relink(nodes, 0, count, above);
+    if(above == nullptr) this->root_ = built;
+    else if(wasLeft) above -> setLeft(built);
+    else above -> setRight(built);
+}
+
+/**
+* BinarySearchTree::buildSubtree for nodes that already exist: makes the
+* middle one of nodes[lo, hi) the root and recurses on each side.
+*/
+template<class Key, class Value, typename Compare>
+Node<Key, Value>* ScapegoatTree<Key, Value, Compare>::relink(
+    std::vector<Node<Key, Value>*>& nodes, std::size_t lo, std::size_t hi, Node<Key, Value>* parent)
+{
+    if(lo >= hi) return nullptr;
+    std::size_t mid = lo + (hi - lo) / 2;
+    Node<Key, Value>* n = nodes[mid];
+    n -> setParent(parent);
+    n -> setLeft(relink(nodes, lo, mid, n));
+    n -> setRight(relink(nodes, mid + 1, hi, n));
+    n -> setSize(hi - lo);
+    return n;
+}
+
+/*
+--------------------------------------------------------------
+End implementations for the ScapegoatTree class.
+--------------------------------------------------------------
+*/
+
+#endif
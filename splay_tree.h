@@ -0,0 +1,274 @@
+#ifndef SPLAY_TREE_H
+#define SPLAY_TREE_H
+
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include "bst.h"
+
+/**
+* How far a SplayTree moves the node it just touched. FULL_SPLAY brings it
+* to the root. SEMI_SPLAY only halves its depth, making about half as many
+* rotations (and so writes) per operation while still keeping hot keys
+* near the top.
+*/
+enum SplayMode { FULL_SPLAY, SEMI_SPLAY };
+
+/**
+* A self-adjusting binary search tree: every find, insert and remove
+* rotates the node it reached up towards the root, so keys that are used
+* often stay close to the root and skewed workloads get shallow searches.
+* Any sequence of operations costs O(log n) amortized each; a single one
+* may be O(n).
+*
+* Nodes are plain Nodes with no balance information. Lookups through a
+* const SplayTree (or a reference to the base class) do not splay.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class SplayTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    SplayTree();
+    explicit SplayTree(const Compare& comp);
+    explicit SplayTree(SplayMode mode, const Compare& comp = Compare());
+    virtual void insert(const std::pair<const Key, Value>& keyValuePair);
+    virtual void insert(std::pair<const Key, Value>&& keyValuePair);
+    virtual void remove(const Key& key);
+
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator iterator;
+
+    // The const versions from BinarySearchTree search without splaying
+    using BinarySearchTree<Key, Value, Compare>::find;
+    using BinarySearchTree<Key, Value, Compare>::operator[];
+    iterator find(const Key& key);
+    Value& operator[](const Key& key);
+
+    SplayMode mode() const;
+
+protected:
+    virtual void linkNode(Node<Key, Value>* n, Node<Key, Value>* parent, bool goRight);
+    template<typename K, typename M>
+    void assignAndSplay(K&& key, M&& obj);
+    void splay(Node<Key, Value>* n);
+    void rotateUp(Node<Key, Value>* n);
+
+    SplayMode mode_;
+};
+
+/*
+--------------------------------------------------------------
+Begin implementations for the SplayTree class.
+--------------------------------------------------------------
+*/
+
+template<class Key, class Value, typename Compare>
+SplayTree<Key, Value, Compare>::SplayTree() :
+    BinarySearchTree<Key, Value, Compare>(), mode_(FULL_SPLAY)
+{
+
+}
+
+template<class Key, class Value, typename Compare>
+SplayTree<Key, Value, Compare>::SplayTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp), mode_(FULL_SPLAY)
+{
+
+}
+
+/**
+* Constructor for an empty tree that splays as mode says.
+*/
+template<class Key, class Value, typename Compare>
+SplayTree<Key, Value, Compare>::SplayTree(SplayMode mode, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp), mode_(mode)
+{
+
+}
+
+template<class Key, class Value, typename Compare>
+SplayMode SplayTree<Key, Value, Compare>::mode() const
+{
+    return mode_;
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present,
+* and splays the node either way.
+*/
+template<class Key, class Value, typename Compare>
+void SplayTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    assignAndSplay(keyValuePair.first, keyValuePair.second);
+}
+
+/**
+* Same as above, but moves the value out of keyValuePair instead of copying it.
+*/
+template<class Key, class Value, typename Compare>
+void SplayTree<Key, Value, Compare>::insert(std::pair<const Key, Value>&& keyValuePair)
+{
+    assignAndSplay(keyValuePair.first, std::move(keyValuePair.second));
+}
+
+/**
+* BinarySearchTree::assignUnique, except that an existing node is splayed
+* too (a new one is splayed by linkNode).
+*/
+template<class Key, class Value, typename Compare>
+template<typename K, typename M>
+void SplayTree<Key, Value, Compare>::assignAndSplay(K&& key, M&& obj)
+{
+    Node<Key, Value>* parent;
+    bool goRight;
+    Node<Key, Value>* existing = this->findSlot(key, parent, goRight);
+    if(existing != nullptr)
+    {
+        existing -> getValue() = std::forward<M>(obj);
+        splay(existing);
+        return;
+    }
+    PiecewiseItem<Key, Value, std::tuple<K&&>, std::tuple<M&&> > item(
+        std::forward_as_tuple(std::forward<K>(key)),
+        std::forward_as_tuple(std::forward<M>(obj)));
+    Node<Key, Value>* n = this->makeNode(parent, item);
+    linkNode(n, parent, goRight);
+}
+
+/**
+* Links the new node in as a leaf and splays it. Also used by emplace,
+* try_emplace and insert_or_assign.
+*/
+template<class Key, class Value, typename Compare>
+void SplayTree<Key, Value, Compare>::linkNode(Node<Key, Value>* n, Node<Key, Value>* parent, bool goRight)
+{
+    BinarySearchTree<Key, Value, Compare>::linkNode(n, parent, goRight);
+    splay(n);
+}
+
+/**
+* Splays the node with the given key, or the last node the search looked
+* at if the key is missing, so that misses pay for themselves as well.
+*/
+template<class Key, class Value, typename Compare>
+typename SplayTree<Key, Value, Compare>::iterator
+SplayTree<Key, Value, Compare>::find(const Key& key)
+{
+    Node<Key, Value>* parent;
+    bool goRight;
+    Node<Key, Value>* found = this->findSlot(key, parent, goRight);
+    if(found != nullptr)
+    {
+        splay(found);
+        return this->makeIterator(found);
+    }
+    if(parent != nullptr) splay(parent);
+    return this->end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key, after splaying it
+ */
+template<class Key, class Value, typename Compare>
+Value& SplayTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if(it == this->end()) throw std::out_of_range("Invalid key");
+    return it -> second;
+}
+
+/**
+* Splays the node to remove, which in FULL_SPLAY mode puts it at the root
+* where only its own children need relinking, and then removes it as
+* BinarySearchTree does. A missing key splays the last node looked at.
+*/
+template<class Key, class Value, typename Compare>
+void SplayTree<Key, Value, Compare>::remove(const Key& key)
+{
+    Node<Key, Value>* parent;
+    bool goRight;
+    Node<Key, Value>* current = this->findSlot(key, parent, goRight);
+    if(current == nullptr)
+    {
+        if(parent != nullptr) splay(parent);
+        return;
+    }
+    splay(current);
+
+    //which side of its parent it hangs off, only semi-splaying leaves one
+    int child = 0;
+    if(current -> getParent() != nullptr)
+    {
+        if(current == current -> getParent() -> getRight()) child = 1;
+        else child = -1;
+    }
+    this->removeHelper(current, child);
+    this->destroyNode(current);
+}
+
+/**
+* Rotates n above its parent.
+*/
+template<class Key, class Value, typename Compare>
+void SplayTree<Key, Value, Compare>::rotateUp(Node<Key, Value>* n)
+{
+    Node<Key, Value>* p = n -> getParent();
+    if(n == p -> getLeft())
+    {
+        BinarySearchTree<Key, Value, Compare>::rotateRight(p);
+    }
+    else
+    {
+        BinarySearchTree<Key, Value, Compare>::rotateLeft(p);
+    }
+}
+
+/**
+* Moves n up two levels at a time. In the zig-zig case (n and its parent
+* are children on the same side) a full splay rotates the parent and then
+* n, while a semi-splay only rotates the parent and carries on from there,
+* leaving n where it is. The zig-zag and final zig steps are the same in
+* both modes. Whichever node ends up on top becomes the root.
+*/
+template<class Key, class Value, typename Compare>
+void SplayTree<Key, Value, Compare>::splay(Node<Key, Value>* n)
+{
+    while(n -> getParent() != nullptr)
+    {
+        Node<Key, Value>* p = n -> getParent();
+        Node<Key, Value>* g = p -> getParent();
+        //zig, p is the root
+        if(g == nullptr)
+        {
+            rotateUp(n);
+        }
+        //zig-zig
+        else if((n == p -> getLeft()) == (p == g -> getLeft()))
+        {
+            rotateUp(p);
+            if(mode_ == SEMI_SPLAY)
+            {
+                n = p;
+            }
+            else
+            {
+                rotateUp(n);
+            }
+        }
+        //zig-zag
+        else
+        {
+            rotateUp(n);
+            rotateUp(n);
+        }
+    }
+    this->root_ = n;
+}
+
+/*
+--------------------------------------------------------------
+End implementations for the SplayTree class.
+--------------------------------------------------------------
+*/
+
+#endif
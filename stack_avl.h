@@ -0,0 +1,587 @@
+#ifndef STACK_AVL_H
+#define STACK_AVL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "node_pool.h"
+
+/**
+* An AVLTree whose nodes have no parent pointers. Everything that used to
+* climb the tree keeps the path down from the root instead: insert and
+* remove record it in a fixed array as they descend and retrace it to fix
+* balances and rotate, and iterators carry a small stack of the ancestors
+* still to be visited. A node is then just the item, two child pointers
+* and a balance factor, 32 bytes for AVLTree<int, int>'s 48, and rotations
+* have one pointer fewer to store per node they move.
+*
+* Nodes do not record subtree sizes either, so there is no select or rank,
+* and iterators only go forwards. Iterators stay valid until the tree is
+* changed.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class StackAVLTree
+{
+private:
+    struct Node
+    {
+        Node(const Key& key, const Value& value);
+
+        std::pair<const Key, Value> item;
+        Node* left;
+        Node* right;
+        int8_t balance;
+    };
+
+public:
+    StackAVLTree();
+    explicit StackAVLTree(const Compare& comp);
+    ~StackAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+    static std::size_t nodeBytes();
+    bool isBalanced() const;
+
+    /**
+    * An iterator over the items in key order. Since nodes know nothing of
+    * their parents it keeps the path down from the root.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    private:
+        friend class StackAVLTree<Key, Value, Compare>;
+        void pushLeft(Node* n);
+        // the current node last, below it every ancestor still to be visited
+        std::vector<Node*> path_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    // Not copyable, like the other pool-backed trees.
+    StackAVLTree(const StackAVLTree& other);
+    StackAVLTree& operator=(const StackAVLTree& other);
+
+    // An AVL tree of n nodes is under 1.45 log2(n + 2) deep, so this
+    // covers any tree that fits in memory
+    static const int MAX_HEIGHT = 64;
+
+    // The path from the root to the node an update is working on: node[i]
+    // and whether the path went right from it.
+    struct Path
+    {
+        Node* node[MAX_HEIGHT];
+        bool right[MAX_HEIGHT];
+        int depth;
+    };
+
+    Node*& linkTo(Path& path, int i);
+    static Node* rotateLeft(Node* n);
+    static Node* rotateRight(Node* n);
+    static Node* rebalance(Node* n);
+    static int checkedHeight(const Node* n);
+    Node* findNode(const Key& key) const;
+    Node* createNode(const Key& key, const Value& value);
+    void destroyNode(Node* n);
+
+    Node* root_;
+    std::size_t size_;
+    Compare comp_;
+    NodePool pool_;
+};
+
+template<class Key, class Value, class Compare>
+StackAVLTree<Key, Value, Compare>::Node::Node(const Key& key, const Value& value) :
+    item(key, value),
+    left(nullptr),
+    right(nullptr),
+    balance(0)
+{
+
+}
+
+/*
+----------------------------------------------------
+Begin implementations for the StackAVLTree::iterator class.
+----------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to the end.
+*/
+template<class Key, class Value, class Compare>
+StackAVLTree<Key, Value, Compare>::iterator::iterator()
+{
+
+}
+
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>& StackAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return path_.back()->item;
+}
+
+template<class Key, class Value, class Compare>
+std::pair<const Key, Value>* StackAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(path_.back()->item);
+}
+
+/**
+* Iterators are equal when they are at the same node; all end iterators
+* have an empty path.
+*/
+template<class Key, class Value, class Compare>
+bool StackAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    if(path_.empty() || rhs.path_.empty()) return path_.empty() && rhs.path_.empty();
+    return path_.back() == rhs.path_.back();
+}
+
+template<class Key, class Value, class Compare>
+bool StackAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Pushes n and its chain of left children, ending at the smallest node
+* of n's subtree.
+*/
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::iterator::pushLeft(Node* n)
+{
+    while(n != nullptr)
+    {
+        path_.push_back(n);
+        n = n->left;
+    }
+}
+
+/**
+* Advances to the smallest node of the right subtree if there is one,
+* otherwise to the nearest ancestor still on the path.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::iterator&
+StackAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    Node* current = path_.back();
+    path_.pop_back();
+    pushLeft(current->right);
+    return *this;
+}
+
+/*
+--------------------------------------------------
+End implementations for the StackAVLTree::iterator class.
+--------------------------------------------------
+*/
+
+/*
+-------------------------------------------
+Begin implementations for the StackAVLTree class.
+-------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+StackAVLTree<Key, Value, Compare>::StackAVLTree() :
+    root_(nullptr), size_(0), comp_(), pool_(sizeof(Node))
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by the given comparator.
+*/
+template<class Key, class Value, class Compare>
+StackAVLTree<Key, Value, Compare>::StackAVLTree(const Compare& comp) :
+    root_(nullptr), size_(0), comp_(comp), pool_(sizeof(Node))
+{
+
+}
+
+template<class Key, class Value, class Compare>
+StackAVLTree<Key, Value, Compare>::~StackAVLTree()
+{
+    clear();
+}
+
+/**
+* Runs every node's destructor, using a stack instead of parent pointers
+* to get around, then hands all the memory back at once.
+*/
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::clear()
+{
+    if(!std::is_trivially_destructible<std::pair<const Key, Value> >::value && root_ != nullptr)
+    {
+        std::vector<Node*> pending(1, root_);
+        while(!pending.empty())
+        {
+            Node* n = pending.back();
+            pending.pop_back();
+            if(n->left != nullptr) pending.push_back(n->left);
+            if(n->right != nullptr) pending.push_back(n->right);
+            n->~Node();
+        }
+    }
+    root_ = nullptr;
+    size_ = 0;
+    pool_.release();
+}
+
+template<class Key, class Value, class Compare>
+bool StackAVLTree<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+template<class Key, class Value, class Compare>
+std::size_t StackAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+* The pool memory each item takes.
+*/
+template<class Key, class Value, class Compare>
+std::size_t StackAVLTree<Key, Value, Compare>::nodeBytes()
+{
+    return NodePool(sizeof(Node)).blockSize();
+}
+
+/**
+* Return true iff every node's stored balance is its right height minus
+* its left height, and within one.
+*/
+template<class Key, class Value, class Compare>
+bool StackAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    return checkedHeight(root_) != -1;
+}
+
+/**
+* The height of n's subtree, or -1 if a balance under it is wrong.
+*/
+template<class Key, class Value, class Compare>
+int StackAVLTree<Key, Value, Compare>::checkedHeight(const Node* n)
+{
+    if(n == nullptr) return 0;
+    int left = checkedHeight(n->left);
+    int right = checkedHeight(n->right);
+    if(left == -1 || right == -1) return -1;
+    if(n->balance != right - left || std::abs(right - left) > 1) return -1;
+    return std::max(left, right) + 1;
+}
+
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::Node*
+StackAVLTree<Key, Value, Compare>::createNode(const Key& key, const Value& value)
+{
+    void* block = pool_.allocate();
+    try
+    {
+        return new (block) Node(key, value);
+    }
+    catch(...)
+    {
+        pool_.deallocate(block);
+        throw;
+    }
+}
+
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::destroyNode(Node* n)
+{
+    n->~Node();
+    pool_.deallocate(n);
+}
+
+/**
+* The pointer that holds path.node[i]: root_ or a child link of the node
+* above it. Assigning to it replaces that subtree.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::Node*&
+StackAVLTree<Key, Value, Compare>::linkTo(Path& path, int i)
+{
+    if(i == 0) return root_;
+    Node* above = path.node[i - 1];
+    return path.right[i - 1] ? above->right : above->left;
+}
+
+/**
+* Rotates n's right child up into its place and returns it. The balances
+* are worked out from the old ones for any shape, so the same rotation
+* serves insert, remove and both halves of a double rotation.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::Node*
+StackAVLTree<Key, Value, Compare>::rotateLeft(Node* n)
+{
+    Node* top = n->right;
+    n->right = top->left;
+    top->left = n;
+    int nBalance = n->balance - 1 - std::max<int>(top->balance, 0);
+    int topBalance = top->balance - 1 + std::min(nBalance, 0);
+    n->balance = static_cast<int8_t>(nBalance);
+    top->balance = static_cast<int8_t>(topBalance);
+    return top;
+}
+
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::Node*
+StackAVLTree<Key, Value, Compare>::rotateRight(Node* n)
+{
+    Node* top = n->left;
+    n->left = top->right;
+    top->right = n;
+    int nBalance = n->balance + 1 - std::min<int>(top->balance, 0);
+    int topBalance = top->balance + 1 + std::max(nBalance, 0);
+    n->balance = static_cast<int8_t>(nBalance);
+    top->balance = static_cast<int8_t>(topBalance);
+    return top;
+}
+
+/**
+* Fixes n, whose balance has reached 2 or -2, with a single or double
+* rotation and returns the subtree's new top.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::Node*
+StackAVLTree<Key, Value, Compare>::rebalance(Node* n)
+{
+    if(n->balance > 0)
+    {
+        if(n->right->balance < 0) n->right = rotateRight(n->right);
+        return rotateLeft(n);
+    }
+    if(n->left->balance > 0) n->left = rotateLeft(n->left);
+    return rotateRight(n);
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+* The search records its path; the new leaf then raises each balance on
+* the way back up until one returns to 0 or a rotation restores the
+* subtree's old height.
+*/
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Key& key = keyValuePair.first;
+    Path path;
+    path.depth = 0;
+    Node* current = root_;
+    while(current != nullptr)
+    {
+        bool goRight;
+        if(comp_(key, current->item.first)) goRight = false;
+        else if(comp_(current->item.first, key)) goRight = true;
+        else
+        {
+            current->item.second = keyValuePair.second;
+            return;
+        }
+        path.node[path.depth] = current;
+        path.right[path.depth] = goRight;
+        ++path.depth;
+        current = goRight ? current->right : current->left;
+    }
+    linkTo(path, path.depth) = createNode(key, keyValuePair.second);
+    ++size_;
+
+    for(int i = path.depth - 1; i >= 0; --i)
+    {
+        Node* p = path.node[i];
+        p->balance += path.right[i] ? 1 : -1;
+        if(p->balance == 0) break;
+        if(p->balance == 1 || p->balance == -1) continue;
+        linkTo(path, i) = rebalance(p);
+        break;
+    }
+}
+
+/**
+* Removes the key if present. A node with two children is replaced by its
+* successor, which takes over its place on the recorded path; the balances
+* are then fixed going back up for as long as the subtree below got
+* shorter.
+*/
+template<class Key, class Value, class Compare>
+void StackAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    Path path;
+    path.depth = 0;
+    Node* target = root_;
+    while(target != nullptr)
+    {
+        bool goRight;
+        if(comp_(key, target->item.first)) goRight = false;
+        else if(comp_(target->item.first, key)) goRight = true;
+        else break;
+        path.node[path.depth] = target;
+        path.right[path.depth] = goRight;
+        ++path.depth;
+        target = goRight ? target->right : target->left;
+    }
+    if(target == nullptr) return;
+
+    if(target->left != nullptr && target->right != nullptr)
+    {
+        int targetDepth = path.depth;
+        path.node[path.depth] = target;
+        path.right[path.depth] = true;
+        ++path.depth;
+        Node* successor = target->right;
+        while(successor->left != nullptr)
+        {
+            path.node[path.depth] = successor;
+            path.right[path.depth] = false;
+            ++path.depth;
+            successor = successor->left;
+        }
+        //unhook the successor, then put it where target was
+        linkTo(path, path.depth) = successor->right;
+        successor->left = target->left;
+        successor->right = target->right;
+        successor->balance = target->balance;
+        linkTo(path, targetDepth) = successor;
+        path.node[targetDepth] = successor;
+    }
+    else
+    {
+        linkTo(path, path.depth) = (target->left != nullptr) ? target->left : target->right;
+    }
+    destroyNode(target);
+    --size_;
+
+    for(int i = path.depth - 1; i >= 0; --i)
+    {
+        Node* p = path.node[i];
+        p->balance -= path.right[i] ? 1 : -1;
+        if(p->balance == 1 || p->balance == -1) break;
+        if(p->balance == 0) continue;
+        //a rotation around a balanced child leaves the height as it was
+        Node* child = (p->balance > 0) ? p->right : p->left;
+        bool shorter = child->balance != 0;
+        linkTo(path, i) = rebalance(p);
+        if(!shorter) break;
+    }
+}
+
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::iterator StackAVLTree<Key, Value, Compare>::begin() const
+{
+    iterator it;
+    it.pushLeft(root_);
+    return it;
+}
+
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::iterator StackAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key or end() if the key
+* is not in the tree. Nodes where the search turns left are kept on the
+* iterator's path since they come after the result.
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::iterator StackAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it;
+    Node* current = root_;
+    while(current != nullptr)
+    {
+        if(comp_(key, current->item.first))
+        {
+            it.path_.push_back(current);
+            current = current->left;
+        }
+        else if(comp_(current->item.first, key))
+        {
+            current = current->right;
+        }
+        else
+        {
+            it.path_.push_back(current);
+            return it;
+        }
+    }
+    return end();
+}
+
+/**
+* Plain search for key, for lookups that need no iterator (and so no path).
+*/
+template<class Key, class Value, class Compare>
+typename StackAVLTree<Key, Value, Compare>::Node* StackAVLTree<Key, Value, Compare>::findNode(const Key& key) const
+{
+    Node* current = root_;
+    while(current != nullptr)
+    {
+        if(comp_(key, current->item.first)) current = current->left;
+        else if(comp_(current->item.first, key)) current = current->right;
+        else return current;
+    }
+    return nullptr;
+}
+
+/**
+ * @precondition The key exists in the tree
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value& StackAVLTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    Node* n = findNode(key);
+    if(n == nullptr) throw std::out_of_range("Invalid key");
+    return n->item.second;
+}
+
+template<class Key, class Value, class Compare>
+Value const & StackAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    Node* n = findNode(key);
+    if(n == nullptr) throw std::out_of_range("Invalid key");
+    return n->item.second;
+}
+
+/*
+-----------------------------------------
+End implementations for the StackAVLTree class.
+-----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Selects the parallel overload of a constructor, as in
+* AVLTree<int, int> tree(ParallelTag(), items.begin(), items.end()).
+*/
+struct ParallelTag { };
+
+/**
+* A fixed set of worker threads for fork-join parallelism, used by the
+* trees' bulk operations. forkJoin(left, right) offers right to the workers,
+* runs left on the calling thread and then waits for right; while waiting
+* the caller runs other queued tasks itself, so tasks may fork further
+* tasks without the pool deadlocking however few threads it has.
+*
+* Work is spread by stealing. Every worker has its own deque of forked
+* tasks (threads outside the pool share one more). A thread pushes and pops
+* at the back of its own deque, so it keeps working depth first on the
+* pieces it just split off, while an idle worker steals from the front of
+* someone else's, taking the oldest and so usually the largest piece.
+* Stealing only touches the victim's deque, so busy threads rarely meet.
+*
+* With no workers (a single core machine) forkJoin just runs both halves in
+* turn on the caller.
+*/
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned threads = defaultThreads());
+    ~ThreadPool();
+
+    template<typename Left, typename Right>
+    void forkJoin(Left left, Right right);
+    unsigned workers() const;
+
+    static ThreadPool& shared();
+    static unsigned defaultThreads();
+
+private:
+    // Not copyable, the workers keep a pointer to the pool.
+    ThreadPool(const ThreadPool& other);
+    ThreadPool& operator=(const ThreadPool& other);
+
+    struct Task
+    {
+        std::function<void()> run;
+        std::exception_ptr error;
+        std::atomic<bool> done;
+    };
+
+    // One thread's forked tasks, oldest at the front.
+    struct TaskQueue
+    {
+        std::mutex lock;
+        std::deque<Task*> tasks;
+    };
+
+    std::size_t ownQueue() const;
+    void push(Task* task);
+    Task* popOwn(std::size_t queue);
+    Task* steal(std::size_t thief);
+    bool runOne();
+    void execute(Task* task);
+    void workerLoop(std::size_t index);
+
+    // The index of the calling thread's queue in the pool it works for
+    static const ThreadPool*& currentPool();
+    static std::size_t& currentQueue();
+
+    // queues_[i] belongs to worker i, the last one to every other thread
+    std::vector<std::unique_ptr<TaskQueue> > queues_;
+    // Tasks queued and not yet taken, so idle workers know when to sleep
+    std::atomic<std::size_t> pending_;
+    std::mutex sleepLock_;
+    std::condition_variable ready_;
+    bool stopping_;
+    std::vector<std::thread> threads_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the ThreadPool class.
+  ---------------------------------------------
+*/
+
+/**
+* Starts threads workers; together with the threads calling forkJoin that
+* keeps every core busy by default.
+*/
+inline ThreadPool::ThreadPool(unsigned threads) :
+    pending_(0),
+    stopping_(false)
+{
+    for(unsigned i = 0; i <= threads; ++i)
+    {
+        queues_.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+    }
+    for(unsigned i = 0; i < threads; ++i)
+    {
+        threads_.push_back(std::thread(&ThreadPool::workerLoop, this, static_cast<std::size_t>(i)));
+    }
+}
+
+/**
+* Stops and joins the workers. No forkJoin may still be running.
+*/
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleepLock_);
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    for(std::size_t i = 0; i < threads_.size(); ++i)
+    {
+        threads_[i].join();
+    }
+}
+
+/**
+* One worker per core besides the thread that forks.
+*/
+inline unsigned ThreadPool::defaultThreads()
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    return (cores > 1) ? cores - 1 : 0;
+}
+
+/**
+* A pool shared by everything in the process, started on first use.
+*/
+inline ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+inline unsigned ThreadPool::workers() const
+{
+    return static_cast<unsigned>(threads_.size());
+}
+
+inline const ThreadPool*& ThreadPool::currentPool()
+{
+    static thread_local const ThreadPool* pool = nullptr;
+    return pool;
+}
+
+inline std::size_t& ThreadPool::currentQueue()
+{
+    static thread_local std::size_t queue = 0;
+    return queue;
+}
+
+/**
+* The queue the calling thread pushes to: its own if it is one of this
+* pool's workers, else the one shared by outside threads.
+*/
+inline std::size_t ThreadPool::ownQueue() const
+{
+    return (currentPool() == this) ? currentQueue() : queues_.size() - 1;
+}
+
+/**
+* Runs left and right, possibly at the same time, and returns once both
+* have finished. An exception thrown by either is rethrown here.
+*/
+template<typename Left, typename Right>
+void ThreadPool::forkJoin(Left left, Right right)
+{
+    if(threads_.empty())
+    {
+        left();
+        right();
+        return;
+    }
+
+    Task task;
+    task.run = right;
+    task.done.store(false, std::memory_order_relaxed);
+    push(&task);
+
+    std::exception_ptr leftError;
+    try
+    {
+        left();
+    }
+    catch(...)
+    {
+        leftError = std::current_exception();
+    }
+
+    //help out rather than block, right may be queued behind other tasks
+    //or already running on a thief
+    while(!task.done.load(std::memory_order_acquire))
+    {
+        if(!runOne()) std::this_thread::yield();
+    }
+    if(leftError) std::rethrow_exception(leftError);
+    if(task.error) std::rethrow_exception(task.error);
+}
+
+inline void ThreadPool::push(Task* task)
+{
+    //counted first so a thief never takes it before it is counted
+    pending_.fetch_add(1, std::memory_order_release);
+    TaskQueue& queue = *queues_[ownQueue()];
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(task);
+    }
+    //taking the lock orders this with a worker deciding to sleep
+    {
+        std::lock_guard<std::mutex> guard(sleepLock_);
+    }
+    ready_.notify_one();
+}
+
+/**
+* Takes the newest task from the given queue, the one most likely to still
+* be in this thread's cache.
+*/
+inline ThreadPool::Task* ThreadPool::popOwn(std::size_t queue)
+{
+    TaskQueue& own = *queues_[queue];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if(own.tasks.empty()) return nullptr;
+    Task* task = own.tasks.back();
+    own.tasks.pop_back();
+    pending_.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+}
+
+/**
+* Takes the oldest task from the first other queue that has one, starting
+* after the thief's own so that thieves spread over their victims.
+*/
+inline ThreadPool::Task* ThreadPool::steal(std::size_t thief)
+{
+    std::size_t count = queues_.size();
+    for(std::size_t i = 1; i < count; ++i)
+    {
+        TaskQueue& victim = *queues_[(thief + i) % count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if(victim.tasks.empty()) continue;
+        Task* task = victim.tasks.front();
+        victim.tasks.pop_front();
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+    }
+    return nullptr;
+}
+
+/**
+* Runs one queued task, if there is any: the caller's own newest, or else
+* one stolen from another thread.
+*/
+inline bool ThreadPool::runOne()
+{
+    std::size_t queue = ownQueue();
+    Task* task = popOwn(queue);
+    if(task == nullptr) task = steal(queue);
+    if(task == nullptr) return false;
+    execute(task);
+    return true;
+}
+
+inline void ThreadPool::execute(Task* task)
+{
+    try
+    {
+        task->run();
+    }
+    catch(...)
+    {
+        task->error = std::current_exception();
+    }
+    task->done.store(true, std::memory_order_release);
+}
+
+/**
+* Each worker runs tasks until there are none left anywhere and then sleeps
+* until one is pushed or the pool is stopping.
+*/
+inline void ThreadPool::workerLoop(std::size_t index)
+{
+    currentPool() = this;
+    currentQueue() = index;
+    while(true)
+    {
+        if(runOne()) continue;
+        std::unique_lock<std::mutex> guard(sleepLock_);
+        while(pending_.load(std::memory_order_acquire) == 0 && !stopping_)
+        {
+            ready_.wait(guard);
+        }
+        if(stopping_ && pending_.load(std::memory_order_acquire) == 0) return;
+    }
+}
+
+/*
+  -------------------------------------------
+  End implementations for the ThreadPool class.
+  -------------------------------------------
+*/
+
+#endif
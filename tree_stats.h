@@ -0,0 +1,168 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+/**
+* Counters for the work done on a search tree's hot paths, for working out
+* where the time of a slow workload goes. They are only kept in builds with
+* BST_STATS defined (make DEFS=-DBST_STATS); otherwise TREE_STAT expands to
+* nothing, no counter is touched and the trees compile exactly as before.
+*
+* Each tree keeps its own TreeCounters, relaxed atomics that any thread may
+* add to, so a ThreadPool worker's share of a parallel operation lands on
+* the tree it worked on. BinarySearchTree::stats() copies them into a
+* TreeStats, which any thread may take, while the tree is in use too.
+*/
+struct TreeStats
+{
+#ifdef BST_STATS
+    static const bool ENABLED = true;
+#else
+    static const bool ENABLED = false;
+#endif
+    // Searches deeper than this are counted in the last histogram bucket
+    static const int MAX_DEPTH = 64;
+
+    // rotateLeft and rotateRight calls
+    unsigned long long rotations;
+    // Levels insertFix and removeFix climbed, one per call
+    unsigned long long insertFixSteps;
+    unsigned long long removeFixSteps;
+    // Key comparisons made by internalFind
+    unsigned long long comparisons;
+    // Parent links successor followed to leave a right subtree
+    unsigned long long successorClimbs;
+    // depthHistogram[d] counts the internalFind searches that looked at d
+    // nodes before stopping
+    unsigned long long depthHistogram[MAX_DEPTH];
+
+    TreeStats();
+    void reset();
+    unsigned long long searches() const;
+};
+
+/**
+* The live counters behind a tree's TreeStats, one per tree and only kept in
+* BST_STATS builds. Relaxed ordering is enough: each counter is a running
+* total read for its value alone. A copied tree starts counting from zero.
+*/
+struct TreeCounters
+{
+    typedef std::atomic<unsigned long long> Counter;
+
+    Counter rotations;
+    Counter insertFixSteps;
+    Counter removeFixSteps;
+    Counter comparisons;
+    Counter successorClimbs;
+    Counter depthHistogram[TreeStats::MAX_DEPTH];
+
+    TreeCounters();
+    TreeCounters(const TreeCounters& other);
+    TreeCounters& operator=(const TreeCounters& other);
+    void reset();
+    TreeStats snapshot() const;
+    static void add(Counter& counter, unsigned long long n = 1);
+};
+
+#ifdef BST_STATS
+#define TREE_STAT(...) __VA_ARGS__
+#else
+#define TREE_STAT(...)
+#endif
+
+/*
+  -----------------------------------------------------------------
+  Begin implementations for the TreeStats and TreeCounters classes.
+  -----------------------------------------------------------------
+*/
+
+inline TreeStats::TreeStats()
+{
+    reset();
+}
+
+inline void TreeStats::reset()
+{
+    std::memset(this, 0, sizeof(*this));
+}
+
+/**
+* The number of internalFind searches counted.
+*/
+inline unsigned long long TreeStats::searches() const
+{
+    unsigned long long total = 0;
+    for(int i = 0; i < MAX_DEPTH; ++i)
+    {
+        total += depthHistogram[i];
+    }
+    return total;
+}
+
+inline TreeCounters::TreeCounters()
+{
+    reset();
+}
+
+inline TreeCounters::TreeCounters(const TreeCounters&)
+{
+    reset();
+}
+
+/**
+* Leaves the counters alone: they count work done on this tree, not on the
+* one its items came from.
+*/
+inline TreeCounters& TreeCounters::operator=(const TreeCounters&)
+{
+    return *this;
+}
+
+inline void TreeCounters::reset()
+{
+    rotations.store(0, std::memory_order_relaxed);
+    insertFixSteps.store(0, std::memory_order_relaxed);
+    removeFixSteps.store(0, std::memory_order_relaxed);
+    comparisons.store(0, std::memory_order_relaxed);
+    successorClimbs.store(0, std::memory_order_relaxed);
+    for(int i = 0; i < TreeStats::MAX_DEPTH; ++i)
+    {
+        depthHistogram[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+* The counters' current values. Taken while other threads count, each value
+* is exact but they need not all be from the same instant.
+*/
+inline TreeStats TreeCounters::snapshot() const
+{
+    TreeStats stats;
+    stats.rotations = rotations.load(std::memory_order_relaxed);
+    stats.insertFixSteps = insertFixSteps.load(std::memory_order_relaxed);
+    stats.removeFixSteps = removeFixSteps.load(std::memory_order_relaxed);
+    stats.comparisons = comparisons.load(std::memory_order_relaxed);
+    stats.successorClimbs = successorClimbs.load(std::memory_order_relaxed);
+    for(int i = 0; i < TreeStats::MAX_DEPTH; ++i)
+    {
+        stats.depthHistogram[i] = depthHistogram[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+inline void TreeCounters::add(Counter& counter, unsigned long long n)
+{
+    counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+/*
+  ---------------------------------------------------------------
+  End implementations for the TreeStats and TreeCounters classes.
+  ---------------------------------------------------------------
+*/
+
+#endif